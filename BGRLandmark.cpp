@@ -20,9 +20,13 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <list>
 #include <iostream>
 #include "opencv2/highgui.hpp"
+#include "opencv2/core/hal/intrin.hpp"
 #include "BGRLandmark.h"
 
 
@@ -81,6 +85,208 @@ namespace cpoz
 
 
 
+    // gets median of each BGR component in 3x3 neighborhood of a pixel
+    // this is the same as a pixel of a 3x3 medianBlur away from the image border
+    static cv::Vec3f median3x3_bgr(const cv::Mat& rimg, const cv::Point& rpt)
+    {
+        cv::Vec3f result;
+        uchar v[3][9];
+        int n = 0;
+        for (int j = -1; j <= 1; j++)
+        {
+            const cv::Vec3b * p = rimg.ptr<cv::Vec3b>(rpt.y + j) + rpt.x;
+            for (int i = -1; i <= 1; i++)
+            {
+                v[0][n] = p[i][0];
+                v[1][n] = p[i][1];
+                v[2][n] = p[i][2];
+                n++;
+            }
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            std::nth_element(v[k], v[k] + 4, v[k] + 9);
+            result[k] = v[k][4];
+        }
+        return result;
+    }
+
+
+
+    // van Herk/Gil-Werman running min and max of k samples
+    // each window is a suffix of one block of k samples plus a prefix of the next block
+    // so cost is about 3 compares per sample for any k
+    static void vhgw_min_max_row(
+        const uchar * psrc,
+        const int n,
+        const int k,
+        uchar * pgmin,
+        uchar * pgmax,
+        uchar * phmin,
+        uchar * phmax,
+        uchar * pmin,
+        uchar * pmax)
+    {
+        // prefix min and max within each block
+        for (int i = 0; i < n; i++)
+        {
+            if ((i % k) == 0)
+            {
+                pgmin[i] = psrc[i];
+                pgmax[i] = psrc[i];
+            }
+            else
+            {
+                pgmin[i] = std::min(pgmin[i - 1], psrc[i]);
+                pgmax[i] = std::max(pgmax[i - 1], psrc[i]);
+            }
+        }
+
+        // suffix min and max within each block
+        for (int i = n - 1; i >= 0; i--)
+        {
+            if ((i == (n - 1)) || (((i + 1) % k) == 0))
+            {
+                phmin[i] = psrc[i];
+                phmax[i] = psrc[i];
+            }
+            else
+            {
+                phmin[i] = std::min(phmin[i + 1], psrc[i]);
+                phmax[i] = std::max(phmax[i + 1], psrc[i]);
+            }
+        }
+
+        // combine them for each window
+        for (int i = 0; (i + k) <= n; i++)
+        {
+            pmin[i] = std::min(phmin[i], pgmin[i + k - 1]);
+            pmax[i] = std::max(phmax[i], pgmax[i + k - 1]);
+        }
+    }
+
+
+
+    // van Herk/Gil-Werman running min or max of k rows
+    // same as row version but each step is a whole row
+    static void vhgw_min_max_col(
+        const cv::Mat& rsrc,
+        const int k,
+        cv::Mat& rg,
+        cv::Mat& rh,
+        cv::Mat& rdst,
+        const bool is_max)
+    {
+        const int n = rsrc.rows;
+        const int ncols = rsrc.cols;
+        rg.create(rsrc.size(), CV_8U);
+        rh.create(rsrc.size(), CV_8U);
+        rdst.create(n - k + 1, ncols, CV_8U);
+
+        for (int i = 0; i < n; i++)
+        {
+            const uchar * psrc = rsrc.ptr<uchar>(i);
+            uchar * pg = rg.ptr<uchar>(i);
+            const uchar * pg0 = ((i % k) == 0) ? psrc : rg.ptr<uchar>(i - 1);
+            for (int x = 0; x < ncols; x++)
+            {
+                pg[x] = (is_max) ? std::max(pg0[x], psrc[x]) : std::min(pg0[x], psrc[x]);
+            }
+        }
+
+        for (int i = n - 1; i >= 0; i--)
+        {
+            const uchar * psrc = rsrc.ptr<uchar>(i);
+            uchar * ph = rh.ptr<uchar>(i);
+            const uchar * ph0 = ((i == (n - 1)) || (((i + 1) % k) == 0)) ? psrc : rh.ptr<uchar>(i + 1);
+            for (int x = 0; x < ncols; x++)
+            {
+                ph[x] = (is_max) ? std::max(ph0[x], psrc[x]) : std::min(ph0[x], psrc[x]);
+            }
+        }
+
+        for (int i = 0; (i + k) <= n; i++)
+        {
+            const uchar * ph = rh.ptr<uchar>(i);
+            const uchar * pg = rg.ptr<uchar>(i + k - 1);
+            uchar * pdst = rdst.ptr<uchar>(i);
+            for (int x = 0; x < ncols; x++)
+            {
+                pdst[x] = (is_max) ? std::max(ph[x], pg[x]) : std::min(ph[x], pg[x]);
+            }
+        }
+    }
+
+
+
+    // gets min and max of n pixels (SIMD where available)
+    static void min_max_u8(const uchar * p, const int n, uchar& rmin, uchar& rmax)
+    {
+        uchar qmin = 255;
+        uchar qmax = 0;
+        int i = 0;
+#if CV_SIMD
+        if (n >= cv::v_uint8::nlanes)
+        {
+            cv::v_uint8 vmin = cv::vx_setall_u8(255);
+            cv::v_uint8 vmax = cv::vx_setzero_u8();
+            for (; i <= n - cv::v_uint8::nlanes; i += cv::v_uint8::nlanes)
+            {
+                const cv::v_uint8 v = cv::vx_load(p + i);
+                vmin = cv::v_min(vmin, v);
+                vmax = cv::v_max(vmax, v);
+            }
+            uchar bufmin[cv::v_uint8::nlanes];
+            uchar bufmax[cv::v_uint8::nlanes];
+            cv::v_store(bufmin, vmin);
+            cv::v_store(bufmax, vmax);
+            for (int k = 0; k < cv::v_uint8::nlanes; k++)
+            {
+                qmin = std::min(qmin, bufmin[k]);
+                qmax = std::max(qmax, bufmax[k]);
+            }
+        }
+#endif
+        for (; i < n; i++)
+        {
+            qmin = std::min(qmin, p[i]);
+            qmax = std::max(qmax, p[i]);
+        }
+        rmin = qmin;
+        rmax = qmax;
+    }
+
+
+
+    // gets sums over 256 histogram bins: sum(h * v * v) and sum(w * v) (SIMD where available)
+    static void sum_bins_256(const int * ph, const int * pw, const int * pv, int& rhvv, int& rwv)
+    {
+        int hvv = 0;
+        int wv = 0;
+        int i = 0;
+#if CV_SIMD
+        cv::v_int32 vhvv = cv::vx_setzero_s32();
+        cv::v_int32 vwv = cv::vx_setzero_s32();
+        for (; i <= 256 - cv::v_int32::nlanes; i += cv::v_int32::nlanes)
+        {
+            const cv::v_int32 v = cv::vx_load(pv + i);
+            vhvv += cv::vx_load(ph + i) * v * v;
+            vwv += cv::vx_load(pw + i) * v;
+        }
+        hvv = cv::v_reduce_sum(vhvv);
+        wv = cv::v_reduce_sum(vwv);
+#endif
+        for (; i < 256; i++)
+        {
+            hvv += ph[i] * pv[i] * pv[i];
+            wv += pw[i] * pv[i];
+        }
+        rhvv = hvv;
+        rwv = wv;
+    }
+
+
+
     BGRLandmark::BGRLandmark()
     {
         init();
@@ -129,9 +335,21 @@ namespace cpoz
         tmpl_offset.x = fixkh;
         tmpl_offset.y = fixkh;
 
+        // template norms for the batch sqdiff test
+        tmpl_norm2_p = static_cast<int>(tmpl_gray_p.dot(tmpl_gray_p));
+        tmpl_norm2_n = static_cast<int>(tmpl_gray_n.dot(tmpl_gray_n));
+
+        // split template into constant boxes for fast correlation
+        is_tmpl_boxes_ok = create_template_boxes();
+
         is_color_id_enabled = true;
+        is_box_corr_enabled = true;
+        is_batch_verify_enabled = true;
+        is_prefilter_enabled = false;
 
 #ifdef _COLLECT_SAMPLES
+        // samples are only collected when candidates are checked one at a time
+        is_batch_verify_enabled = false;
         samp_ct = 0;
         samples = cv::Mat::zeros({ (kdim + 4) * sampx, (kdim + 4) * sampy }, CV_8UC3);
 #endif
@@ -139,6 +357,19 @@ namespace cpoz
 
 
 
+    void BGRLandmark::perform_match(
+        const cv::Mat& rsrc_nv12,
+        cv::Mat& rtmatch,
+        std::vector<BGRLandmark::landmark_info_t>& rinfo)
+    {
+        // Y plane is the gray image and it is used without a copy
+        // candidates get their BGR pixels straight from the NV12 image
+        const cv::Mat img_y = rsrc_nv12.rowRange(0, (rsrc_nv12.rows * 2) / 3);
+        perform_match(rsrc_nv12, img_y, rtmatch, rinfo);
+    }
+
+
+
     void BGRLandmark::perform_match(
         const cv::Mat& rsrc_bgr,
         const cv::Mat& rsrc,
@@ -151,103 +382,649 @@ namespace cpoz
         // good match will be close to +1.0 or -1.0
         // so take absolute value of result
         cv::Mat tmatch;
-        matchTemplate(rsrc, tmpl_gray_p, tmatch, xmode);
-        rtmatch = abs(tmatch);
+        const bool is_box = is_box_corr_enabled && is_tmpl_boxes_ok;
+        if (is_prefilter_enabled)
+        {
+            // only correlate the runs of tiles that might have a landmark
+            // and leave the rest of the match result as 0
+            tmatch = cv::Mat::zeros(rsrc.rows - kdim + 1, rsrc.cols - kdim + 1, CV_32F);
+            prefilter_tiles(rsrc, vprefilter_runs);
+            if (is_box && !vprefilter_runs.empty())
+            {
+                cv::integral(rsrc, img_sum, img_sqsum, CV_64F, CV_64F);
+            }
+            for (const auto& rrun : vprefilter_runs)
+            {
+                if (is_box)
+                {
+                    correlate_boxes_roi(rrun, tmatch);
+                }
+                else
+                {
+                    cv::Mat tmatch_run(tmatch(rrun));
+                    const cv::Rect roi_src(rrun.x, rrun.y, rrun.width + kdim - 1, rrun.height + kdim - 1);
+                    matchTemplate(rsrc(roi_src), tmpl_gray_p, tmatch_run, xmode);
+                }
+            }
+        }
+        else if (is_box)
+        {
+            correlate_boxes(rsrc, tmatch);
+        }
+        else
+        {
+            matchTemplate(rsrc, tmpl_gray_p, tmatch, xmode);
+        }
 
-        // find local maxima in the match results...
-        cv::Mat maxima_mask;
-        cv::dilate(rtmatch, maxima_mask, cv::Mat());
-        cv::compare(rtmatch, maxima_mask, maxima_mask, cv::CMP_GE);
+        // find local maxima in the match results that are above the threshold
+        find_candidates(tmatch, rtmatch, vcandidates);
+
+        // check each maxima...
+        if (is_batch_verify_enabled)
+        {
+            verify_candidates_batch(rsrc_bgr, rsrc, vcandidates, rinfo);
+        }
+        else
+        {
+            for (const auto& rcand : vcandidates)
+            {
+                verify_candidate(rsrc_bgr, rsrc, rcand, rinfo);
+            }
+        }
+    }
 
-        // then apply absolute threshold to get the best local maxima
-        cv::Mat match_masked = (rtmatch > thr_corr);
-        maxima_mask = maxima_mask & match_masked;
 
-        // collect point locations of all local maxima
-        std::vector<cv::Point> vec_maxima_pts;
-        cv::findNonZero(maxima_mask, vec_maxima_pts);
 
-        // check each maxima...
-        for (const auto& rpt : vec_maxima_pts)
+    void BGRLandmark::perform_match_scales(
+        const cv::Mat& rsrc_bgr,
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        std::vector<BGRLandmark::landmark_scale_info_t>& rinfo,
+        const int levels)
+    {
+        std::vector<landmark_scale_info_t> vfound;
+
+        // build both pyramids once (full size level is not copied)
+        // and stop when the image is too small for the template
+        int nlevels = 1;
+        vscale_bgr.resize(std::max(levels, 1));
+        vscale_gray.resize(std::max(levels, 1));
+        vscale_bgr[0] = rsrc_bgr;
+        vscale_gray[0] = rsrc;
+        for (; nlevels < levels; nlevels++)
         {
-            // positive means black in upper-left/lower-right
-            // negative means black in lower-left/upper-right
-            float corr = tmatch.at<float>(rpt);
+            const cv::Mat& rprev = vscale_gray[nlevels - 1];
+            if ((((rprev.cols + 1) / 2) < kdim) || (((rprev.rows + 1) / 2) < kdim))
+            {
+                break;
+            }
+            cv::pyrDown(vscale_bgr[nlevels - 1], vscale_bgr[nlevels]);
+            cv::pyrDown(vscale_gray[nlevels - 1], vscale_gray[nlevels]);
+        }
 
-            // extract gray region of interest
-            const cv::Rect roi = cv::Rect(rpt, tmpl_gray_p.size());
-            cv::Mat img_roi(rsrc(roi));
+        // find landmarks at each level
+        // and map their centers back to full size image
+        for (int lev = 0; lev < nlevels; lev++)
+        {
+            const int f = 1 << lev;
+            vinfo_scale.clear();
+            perform_match(vscale_bgr[lev], vscale_gray[lev], (lev == 0) ? rtmatch : tmatch_scale, vinfo_scale);
+            for (const auto& r : vinfo_scale)
+            {
+                landmark_scale_info_t lmsinfo{ r, lev, static_cast<double>(f) };
+                lmsinfo.info.ctr = r.ctr * f;
+                vfound.push_back(lmsinfo);
+            }
+        }
 
-            // get gray pixel range stats in ROI
-            double min_roi;
-            double max_roi;
-            cv::minMaxLoc(img_roi, &min_roi, &max_roi);
-            double rng_roi = max_roi - min_roi;
+        // strongest landmarks first
+        std::stable_sort(vfound.begin(), vfound.end(),
+            [](const landmark_scale_info_t& a, const landmark_scale_info_t& b)
+            {
+                return std::fabs(a.info.corr) > std::fabs(b.info.corr);
+            });
+
+        // suppress any landmark within half the size of a stronger one at any level
+        // a landmark at an adjacent level with same sign is the same landmark
+        // so save its match value for interpolating the scale
+        const size_t ibase = rinfo.size();
+        std::vector<double> vcorr_dn;
+        std::vector<double> vcorr_up;
+        for (const auto& r : vfound)
+        {
+            size_t i = ibase;
+            for (; i < rinfo.size(); i++)
+            {
+                const landmark_scale_info_t& rkeep = rinfo[i];
+                const double rad = 0.5 * kdim * std::max(rkeep.scale, r.scale);
+                const cv::Point d = r.info.ctr - rkeep.info.ctr;
+                if ((d.x * d.x + d.y * d.y) < (rad * rad))
+                {
+                    break;
+                }
+            }
 
-            // a landmark ROI should have two dark squares and and two light squares
-            // see if ROI has large range in pixel values and a minimum that is sufficiently dark
-            if ((rng_roi >= thr_pix_rng) && (min_roi <= thr_pix_min))
+            if (i == rinfo.size())
             {
-                // start filling in landmark info
-                landmark_info_t lminfo{ rpt + tmpl_offset, corr, rng_roi, min_roi, -1, 0.0 };
+                rinfo.push_back(r);
+                vcorr_dn.push_back(0.0);
+                vcorr_up.push_back(0.0);
+            }
+            else if ((r.info.corr > 0) == (rinfo[i].info.corr > 0))
+            {
+                const double c = std::fabs(r.info.corr);
+                const size_t j = i - ibase;
+                if (r.level == rinfo[i].level - 1)
+                {
+                    vcorr_dn[j] = std::max(vcorr_dn[j], c);
+                }
+                else if (r.level == rinfo[i].level + 1)
+                {
+                    vcorr_up[j] = std::max(vcorr_up[j], c);
+                }
+            }
+        }
 
-                cv::Mat img_roi_bgr(rsrc_bgr(roi));
-                cv::Mat img_roi_bgr_filt;
+        // fit parabola to match values vs. log2 of scale at this level and its neighbors
+        // a neighbor with no landmark had a match value no better than the threshold
+        for (size_t i = ibase; i < rinfo.size(); i++)
+        {
+            const size_t j = i - ibase;
+            const double c0 = std::fabs(rinfo[i].info.corr);
+            const double cdn = std::max(vcorr_dn[j], thr_corr);
+            const double cup = std::max(vcorr_up[j], thr_corr);
+            const double den = cdn - (2.0 * c0) + cup;
+            double offset = 0.0;
+            if (den < 0.0)
+            {
+                offset = apply_rail<double>(0.5 * (cdn - cup) / den, -0.5, 0.5);
+            }
+            rinfo[i].scale = std::pow(2.0, rinfo[i].level + offset);
+        }
+    }
 
-                // do smoothing of BGR ROI prior to color test
-                cv::medianBlur(img_roi_bgr, img_roi_bgr_filt, 3);
 
-                // equalize gray ROI
-                cv::Mat img_filt_equ;
-                cv::equalizeHist(img_roi, img_filt_equ);
 
-#ifdef _COLLECT_SAMPLES
-                if (samp_ct < 1000)
+    bool BGRLandmark::create_template_boxes(void)
+    {
+        bool result = true;
+        const int kh = kdim / 2;
+        const cv::Rect rois[9] =
+        {
+            { 0, 0, kh, kh },           // upper-left square
+            { kh + 1, 0, kh, kh },      // upper-right square
+            { 0, kh + 1, kh, kh },      // lower-left square
+            { kh + 1, kh + 1, kh, kh }, // lower-right square
+            { kh, 0, 1, kh },           // upper seam
+            { kh, kh + 1, 1, kh },      // lower seam
+            { 0, kh, kh, 1 },           // left seam
+            { kh + 1, kh, kh, 1 },      // right seam
+            { kh, kh, 1, 1 },           // center
+        };
+
+        vtmpl_boxes.clear();
+        for (const auto& rroi : rois)
+        {
+            // every pixel in each box must be the same
+            // and boxes with zero pixels add nothing to correlation
+            double qmin;
+            double qmax;
+            cv::minMaxLoc(tmpl_gray_p(rroi), &qmin, &qmax);
+            result = result && (qmin == qmax);
+            if (qmax != 0.0)
+            {
+                vtmpl_boxes.push_back({ rroi, qmax });
+            }
+        }
+
+        // stats for normalizing correlation like OpenCV
+        cv::Scalar mean;
+        cv::Scalar sdv;
+        cv::meanStdDev(tmpl_gray_p, mean, sdv);
+        tmpl_mean = mean[0];
+        tmpl_norm = sdv[0] * std::sqrt(static_cast<double>(tmpl_gray_p.total()));
+
+        return result;
+    }
+
+
+
+    void BGRLandmark::correlate_boxes(const cv::Mat& rsrc, cv::Mat& rtmatch)
+    {
+        const int ncols = rsrc.cols - kdim + 1;
+        const int nrows = rsrc.rows - kdim + 1;
+
+        // double sums are exact for any image size
+        cv::integral(rsrc, img_sum, img_sqsum, CV_64F, CV_64F);
+        rtmatch.create(nrows, ncols, CV_32F);
+        correlate_boxes_roi(cv::Rect(0, 0, ncols, nrows), rtmatch);
+    }
+
+
+
+    void BGRLandmark::correlate_boxes_roi(const cv::Rect& rroi, cv::Mat& rtmatch) const
+    {
+        const double inv_area = 1.0 / (kdim * kdim);
+
+        for (int y = rroi.y; y < rroi.y + rroi.height; y++)
+        {
+            const double * ps0 = img_sum.ptr<double>(y);
+            const double * ps1 = img_sum.ptr<double>(y + kdim);
+            const double * pq0 = img_sqsum.ptr<double>(y);
+            const double * pq1 = img_sqsum.ptr<double>(y + kdim);
+            float * pdst = rtmatch.ptr<float>(y);
+
+            for (int x = rroi.x; x < rroi.x + rroi.width; x++)
+            {
+                // template and image correlation is a weighted sum of box sums
+                double num = 0.0;
+                for (const auto& r : vtmpl_boxes)
+                {
+                    const double * pb0 = img_sum.ptr<double>(y + r.roi.y) + x + r.roi.x;
+                    const double * pb1 = img_sum.ptr<double>(y + r.roi.y + r.roi.height) + x + r.roi.x;
+                    num += r.val * ((pb1[r.roi.width] - pb1[0]) - (pb0[r.roi.width] - pb0[0]));
+                }
+
+                // subtract template mean and normalize with same rules as OpenCV
+                const double wnd_sum = (ps1[x + kdim] - ps1[x]) - (ps0[x + kdim] - ps0[x]);
+                const double wnd_sum2 = (pq1[x + kdim] - pq1[x]) - (pq0[x + kdim] - pq0[x]);
+                const double diff2 = std::max(wnd_sum2 - (wnd_sum * wnd_sum * inv_area), 0.0);
+                double t = 0.0;
+                num -= wnd_sum * tmpl_mean;
+                if (diff2 > std::min(0.5, 10 * FLT_EPSILON * wnd_sum2))
+                {
+                    t = std::sqrt(diff2) * tmpl_norm;
+                }
+                if (std::fabs(num) < t)
+                {
+                    num /= t;
+                }
+                else if (std::fabs(num) < t * 1.125)
+                {
+                    num = (num > 0) ? 1.0 : -1.0;
+                }
+                else
+                {
+                    num = 0.0;
+                }
+                pdst[x] = static_cast<float>(num);
+            }
+        }
+    }
+
+
+
+    void BGRLandmark::prefilter_tiles(const cv::Mat& rsrc, std::vector<cv::Rect>& rvruns)
+    {
+        const int ncols = rsrc.cols - kdim + 1;
+        const int nrows = rsrc.rows - kdim + 1;
+        const int ntile = PREFILTER_TILE;
+
+        // min and max of each row window then min and max of those over each column window
+        // gives the same min and max as the range test for each template ROI
+        vprefilter_row.resize(rsrc.cols * 4);
+        uchar * pgmin = vprefilter_row.data();
+        uchar * pgmax = pgmin + rsrc.cols;
+        uchar * phmin = pgmax + rsrc.cols;
+        uchar * phmax = phmin + rsrc.cols;
+        prefilter_hmin.create(rsrc.rows, ncols, CV_8U);
+        prefilter_hmax.create(rsrc.rows, ncols, CV_8U);
+        for (int y = 0; y < rsrc.rows; y++)
+        {
+            vhgw_min_max_row(
+                rsrc.ptr<uchar>(y), rsrc.cols, kdim,
+                pgmin, pgmax, phmin, phmax,
+                prefilter_hmin.ptr<uchar>(y), prefilter_hmax.ptr<uchar>(y));
+        }
+        vhgw_min_max_col(prefilter_hmin, kdim, prefilter_g, prefilter_h, prefilter_min, false);
+        vhgw_min_max_col(prefilter_hmax, kdim, prefilter_g, prefilter_h, prefilter_max, true);
+
+        // mark the windows that pass the range test
+        prefilter_mask.create(nrows, ncols, CV_8U);
+        for (int y = 0; y < nrows; y++)
+        {
+            const uchar * pmin = prefilter_min.ptr<uchar>(y);
+            const uchar * pmax = prefilter_max.ptr<uchar>(y);
+            uchar * pmask = prefilter_mask.ptr<uchar>(y);
+            for (int x = 0; x < ncols; x++)
+            {
+                const int rng = pmax[x] - pmin[x];
+                pmask[x] = ((rng >= thr_pix_rng) && (pmin[x] <= thr_pix_min)) ? 255 : 0;
+            }
+        }
+
+        // the local max test needs the 3x3 neighbors of every window that passes
+        cv::dilate(prefilter_mask, prefilter_mask, cv::Mat());
+
+        // find runs of tiles in each row of tiles that have any windows to correlate
+        rvruns.clear();
+        for (int y = 0; y < nrows; y += ntile)
+        {
+            const int h = std::min(ntile, nrows - y);
+            int xrun = -1;
+            for (int x = 0; x < ncols; x += ntile)
+            {
+                const int w = std::min(ntile, ncols - x);
+                const bool is_active = (cv::countNonZero(prefilter_mask(cv::Rect(x, y, w, h))) > 0);
+                if (is_active && (xrun < 0))
+                {
+                    xrun = x;
+                }
+                else if (!is_active && (xrun >= 0))
+                {
+                    rvruns.push_back(cv::Rect(xrun, y, x - xrun, h));
+                    xrun = -1;
+                }
+            }
+            if (xrun >= 0)
+            {
+                rvruns.push_back(cv::Rect(xrun, y, ncols - xrun, h));
+            }
+        }
+    }
+
+
+
+    void BGRLandmark::get_bgr_roi(const cv::Mat& rsrc_color, const cv::Rect& rroi, cv::Mat& rdst) const
+    {
+        if (rsrc_color.type() == CV_8UC3)
+        {
+            // BGR image so just point to the ROI
+            rdst = rsrc_color(rroi);
+        }
+        else
+        {
+            // NV12 has one UV pair for each 2x2 block of Y pixels
+            // so convert the smallest block-aligned region around the ROI
+            // the Y rows are followed by half as many interleaved UV rows
+            const int h = (rsrc_color.rows * 2) / 3;
+            const int x0 = rroi.x & ~1;
+            const int y0 = rroi.y & ~1;
+            const int x1 = (rroi.x + rroi.width + 1) & ~1;
+            const int y1 = (rroi.y + rroi.height + 1) & ~1;
+            nv12_roi.create(((y1 - y0) * 3) / 2, x1 - x0, CV_8UC1);
+            rsrc_color(cv::Rect(x0, y0, x1 - x0, y1 - y0)).copyTo(nv12_roi.rowRange(0, y1 - y0));
+            rsrc_color(cv::Rect(x0, h + (y0 / 2), x1 - x0, (y1 - y0) / 2)).copyTo(nv12_roi.rowRange(y1 - y0, nv12_roi.rows));
+            cv::cvtColor(nv12_roi, nv12_roi_bgr, cv::COLOR_YUV2BGR_NV12);
+            rdst = nv12_roi_bgr(cv::Rect(rroi.x - x0, rroi.y - y0, rroi.width, rroi.height));
+        }
+    }
+
+
+
+    void BGRLandmark::find_candidates(
+        const cv::Mat& rtmatch_signed,
+        cv::Mat& rtmatch,
+        std::vector<candidate_t>& rvcand) const
+    {
+        const int nrows = rtmatch_signed.rows;
+        const int ncols = rtmatch_signed.cols;
+        const float thr = static_cast<float>(thr_corr);
+
+        rvcand.clear();
+        rtmatch.create(rtmatch_signed.size(), CV_32F);
+
+        // absolute value of each row is written one row ahead of the row being checked
+        // so the rows above and below are ready when a row is checked
+        for (int y = -1; y < nrows; y++)
+        {
+            if (y + 1 < nrows)
+            {
+                const float * psrc = rtmatch_signed.ptr<float>(y + 1);
+                float * pabs = rtmatch.ptr<float>(y + 1);
+                for (int x = 0; x < ncols; x++)
+                {
+                    pabs[x] = std::fabs(psrc[x]);
+                }
+            }
+
+            if (y < 0)
+            {
+                continue;
+            }
+
+            // pixels outside the result are ignored (same as border for dilate)
+            const float * p0 = (y > 0) ? rtmatch.ptr<float>(y - 1) : nullptr;
+            const float * p1 = rtmatch.ptr<float>(y);
+            const float * p2 = (y + 1 < nrows) ? rtmatch.ptr<float>(y + 1) : nullptr;
+            for (int x = 0; x < ncols; x++)
+            {
+                const float v = p1[x];
+                if (v > thr)
                 {
-                    cv::Mat img_samp = img_roi_bgr;
-                    //cv::cvtColor(img_filt_equ, img_samp, cv::COLOR_GRAY2BGR);
-                    //cv::cvtColor(img_roi_bgr_filt, img_samp, cv::COLOR_BGR2HSV);
-
-                    int k = tmpl_gray_p.size().width + 4;
-                    int x = (samp_ct % sampx) * k;
-                    int y = (samp_ct / sampx) * k;
-                    cv::Rect roi0 = { {x,y}, cv::Size(k,k) };
-                    cv::Rect roi1 = { {x + 1, y + 1}, cv::Size(k - 2, k - 2) };
-                    // surround each sample with a white border that can be manually re-colored
-                    cv::rectangle(samples, roi1, { 255,255,255 });
-                    cv::Rect roi2 = { {x + 2, y + 2}, cv::Size(k - 4, k - 4) };
-
-                    img_samp.copyTo(samples(roi2));
-                    samp_ct++;
+                    // must be at least as big as all its neighbors
+                    const int xa = (x > 0) ? x - 1 : x;
+                    const int xb = (x + 1 < ncols) ? x + 1 : x;
+                    bool is_max = (v >= p1[xa]) && (v >= p1[xb]);
+                    for (int i = xa; is_max && (i <= xb); i++)
+                    {
+                        is_max = ((p0 == nullptr) || (v >= p0[i])) && ((p2 == nullptr) || (v >= p2[i]));
+                    }
+                    if (is_max)
+                    {
+                        rvcand.push_back({ { x, y }, rtmatch_signed.ptr<float>(y)[x] });
+                    }
+                }
+            }
+        }
+    }
+
+
+
+    void BGRLandmark::verify_candidate(
+        const cv::Mat& rsrc_color,
+        const cv::Mat& rsrc,
+        const candidate_t& rcand,
+        std::vector<BGRLandmark::landmark_info_t>& rinfo)
+    {
+        // positive means black in upper-left/lower-right
+        // negative means black in lower-left/upper-right
+        const cv::Point& rpt = rcand.pt;
+        float corr = rcand.corr;
+
+        // extract gray region of interest
+        const cv::Rect roi = cv::Rect(rpt, tmpl_gray_p.size());
+        cv::Mat img_roi(rsrc(roi));
+
+        // get gray pixel range stats in ROI
+        double min_roi;
+        double max_roi;
+        cv::minMaxLoc(img_roi, &min_roi, &max_roi);
+        double rng_roi = max_roi - min_roi;
+
+        // a landmark ROI should have two dark squares and and two light squares
+        // see if ROI has large range in pixel values and a minimum that is sufficiently dark
+        if ((rng_roi >= thr_pix_rng) && (min_roi <= thr_pix_min))
+        {
+            // start filling in landmark info
+            landmark_info_t lminfo{ rpt + tmpl_offset, corr, rng_roi, min_roi, -1, 0.0 };
+
+            cv::Mat img_roi_bgr;
+            cv::Mat img_roi_bgr_filt;
+            get_bgr_roi(rsrc_color, roi, img_roi_bgr);
+
+            // do smoothing of BGR ROI prior to color test
+            cv::medianBlur(img_roi_bgr, img_roi_bgr_filt, 3);
+
+            // equalize gray ROI
+            cv::Mat img_filt_equ;
+            cv::equalizeHist(img_roi, img_filt_equ);
+
+#ifdef _COLLECT_SAMPLES
+            if (samp_ct < 1000)
+            {
+                cv::Mat img_samp = img_roi_bgr;
+                //cv::cvtColor(img_filt_equ, img_samp, cv::COLOR_GRAY2BGR);
+                //cv::cvtColor(img_roi_bgr_filt, img_samp, cv::COLOR_BGR2HSV);
+
+                int k = tmpl_gray_p.size().width + 4;
+                int x = (samp_ct % sampx) * k;
+                int y = (samp_ct / sampx) * k;
+                cv::Rect roi0 = { {x,y}, cv::Size(k,k) };
+                cv::Rect roi1 = { {x + 1, y + 1}, cv::Size(k - 2, k - 2) };
+                // surround each sample with a white border that can be manually re-colored
+                cv::rectangle(samples, roi1, { 255,255,255 });
+                cv::Rect roi2 = { {x + 2, y + 2}, cv::Size(k - 4, k - 4) };
+
+                img_samp.copyTo(samples(roi2));
+                samp_ct++;
 #if 0
-                    x = (samp_ct % sampx) * k;
-                    y = (samp_ct / sampx) * k;
-                    cv::Rect roi3 = { {x + 2, y + 2}, cv::Size(dct_fv.dim(), dct_fv.dim()) };
-                    grel.copyTo(samples(roi3));
-                    samp_ct++;
+                x = (samp_ct % sampx) * k;
+                y = (samp_ct / sampx) * k;
+                cv::Rect roi3 = { {x + 2, y + 2}, cv::Size(dct_fv.dim(), dct_fv.dim()) };
+                grel.copyTo(samples(roi3));
+                samp_ct++;
 #endif
-                }
+            }
 #endif
-                // sqdiff shape test on filtered, gray, equalized ROI
-                cv::Mat tmatchx;
-                cv::Mat& rtmpl = (lminfo.corr > 0.0) ? tmpl_gray_p : tmpl_gray_n;
-                matchTemplate(img_filt_equ, rtmpl, tmatchx, cv::TM_SQDIFF_NORMED);
-                lminfo.rmatch = tmatchx.at<float>(0, 0);
-                bool is_sqdiff_test_ok = (lminfo.rmatch < thr_sqdiff);
-
-                // optional color test
-                bool is_color_test_ok = true;
-                if (is_sqdiff_test_ok && is_color_id_enabled)
+            // sqdiff shape test on filtered, gray, equalized ROI
+            cv::Mat tmatchx;
+            cv::Mat& rtmpl = (lminfo.corr > 0.0) ? tmpl_gray_p : tmpl_gray_n;
+            matchTemplate(img_filt_equ, rtmpl, tmatchx, cv::TM_SQDIFF_NORMED);
+            lminfo.rmatch = tmatchx.at<float>(0, 0);
+            bool is_sqdiff_test_ok = (lminfo.rmatch < thr_sqdiff);
+
+            // optional color test
+            bool is_color_test_ok = true;
+            if (is_sqdiff_test_ok && is_color_id_enabled)
+            {
+                identify_colors(img_roi_bgr_filt, lminfo);
+                is_color_test_ok = (lminfo.code != -1);
+            }
+
+            if (is_sqdiff_test_ok && is_color_test_ok)
+            {
+                // this is a landmark
+                rinfo.push_back(lminfo);
+            }
+        }
+    }
+
+
+
+    void BGRLandmark::verify_candidates_batch(
+        const cv::Mat& rsrc_color,
+        const cv::Mat& rsrc,
+        const std::vector<candidate_t>& rvcand,
+        std::vector<BGRLandmark::landmark_info_t>& rinfo)
+    {
+        const int kk = kdim * kdim;
+        const size_t n = rvcand.size();
+
+        // gather gray ROIs of all candidates into one contiguous buffer
+        vbatch_gray.resize(n * kk);
+        for (size_t c = 0; c < n; c++)
+        {
+            uchar * pdst = vbatch_gray.data() + (c * kk);
+            for (int j = 0; j < kdim; j++)
+            {
+                const uchar * psrc = rsrc.ptr<uchar>(rvcand[c].pt.y + j) + rvcand[c].pt.x;
+                std::copy(psrc, psrc + kdim, pdst + (j * kdim));
+            }
+        }
+
+        // get gray pixel range stats for every ROI in one pass over the buffer
+        vbatch_min.resize(n);
+        vbatch_max.resize(n);
+        for (size_t c = 0; c < n; c++)
+        {
+            min_max_u8(vbatch_gray.data() + (c * kk), kk, vbatch_min[c], vbatch_max[c]);
+        }
+
+        cv::Mat img_roi_bgr;
+
+        for (size_t c = 0; c < n; c++)
+        {
+            const cv::Point& rpt = rvcand[c].pt;
+            const uchar * pgray = vbatch_gray.data() + (c * kk);
+            double min_roi = vbatch_min[c];
+            double rng_roi = static_cast<double>(vbatch_max[c]) - min_roi;
+
+            // same range and min test as a single candidate
+            if ((rng_roi < thr_pix_rng) || (min_roi > thr_pix_min))
+            {
+                continue;
+            }
+
+            float corr = rvcand[c].corr;
+            landmark_info_t lminfo{ rpt + tmpl_offset, corr, rng_roi, min_roi, -1, 0.0 };
+
+            // the equalized ROI is never written out
+            // each gray level maps to one equalized level so the sums for the sqdiff test
+            // come from a histogram of the ROI and a histogram weighted by the template
+            // so the only per-pixel work is one pass to fill the two histograms
+            // templates are continuous so they are used as one row of pixels
+            const cv::Mat& rtmpl = (lminfo.corr > 0.0) ? tmpl_gray_p : tmpl_gray_n;
+            const int tmpl2 = (lminfo.corr > 0.0) ? tmpl_norm2_p : tmpl_norm2_n;
+            const uchar * pt = rtmpl.ptr<uchar>(0);
+            int hist[256] = { 0 };
+            int hist_t[256] = { 0 };
+            int lut[256] = { 0 };
+            for (int i = 0; i < kk; i++)
+            {
+                hist[pgray[i]]++;
+                hist_t[pgray[i]] += pt[i];
+            }
+
+            // same LUT as equalizeHist
+            int h0 = 0;
+            while (!hist[h0])
+            {
+                h0++;
+            }
+            if (hist[h0] == kk)
+            {
+                lut[h0] = h0;
+            }
+            else
+            {
+                float scale = 255.0f / (kk - hist[h0]);
+                int sum = 0;
+                for (lut[h0++] = 0; h0 < 256; h0++)
                 {
-                    identify_colors(img_roi_bgr_filt, lminfo);
-                    is_color_test_ok = (lminfo.code != -1);
+                    sum += hist[h0];
+                    lut[h0] = cv::saturate_cast<uchar>(sum * scale);
                 }
+            }
 
-                if (is_sqdiff_test_ok && is_color_test_ok)
+            // sqdiff shape test on equalized ROI with same normalization as TM_SQDIFF_NORMED
+            // sums are exact integers here so result can differ from OpenCV by float round-off
+            int wnd2;
+            int cross;
+            sum_bins_256(hist, hist_t, lut, wnd2, cross);
+            const int sqdiff = wnd2 - (2 * cross) + tmpl2;
+            const double t = std::sqrt(static_cast<double>(wnd2)) * std::sqrt(static_cast<double>(tmpl2));
+            lminfo.rmatch = (sqdiff < t) ? static_cast<float>(sqdiff / t) : 1.0f;
+            bool is_sqdiff_test_ok = (lminfo.rmatch < thr_sqdiff);
+
+            // optional color test
+            // only the corner samples are needed from the median-filtered BGR ROI
+            // and their 3x3 neighborhoods are inside the ROI so they can be filtered directly
+            bool is_color_test_ok = true;
+            if (is_sqdiff_test_ok && is_color_id_enabled)
+            {
+                const int a = 1;
+                const int b = kdim - 2;
+                get_bgr_roi(rsrc_color, cv::Rect(rpt, tmpl_gray_p.size()), img_roi_bgr);
+                cv::Vec3f p11 = median3x3_bgr(img_roi_bgr, { a, a });
+                cv::Vec3f p1b = median3x3_bgr(img_roi_bgr, { b, a });
+                cv::Vec3f pb1 = median3x3_bgr(img_roi_bgr, { a, b });
+                cv::Vec3f pbb = median3x3_bgr(img_roi_bgr, { b, b });
+                if (lminfo.corr > 0)
+                {
+                    identify_colors_samples(p11, pbb, p1b, pb1, lminfo);
+                }
+                else
                 {
-                    // this is a landmark
-                    rinfo.push_back(lminfo);
+                    identify_colors_samples(p1b, pb1, p11, pbb, lminfo);
                 }
+                is_color_test_ok = (lminfo.code != -1);
+            }
+
+            if (is_sqdiff_test_ok && is_color_test_ok)
+            {
+                // this is a landmark
+                rinfo.push_back(lminfo);
             }
         }
     }
@@ -433,6 +1210,23 @@ namespace cpoz
             pc1 = rimg.at<cv::Vec3b>(kdim - 2, kdim - 2);
         }
 
+        identify_colors_samples(pg0, pg1, pc0, pc1, rinfo);
+    }
+
+
+
+    void BGRLandmark::identify_colors_samples(
+        const cv::Vec3f& rpg0,
+        const cv::Vec3f& rpg1,
+        const cv::Vec3f& rpc0,
+        const cv::Vec3f& rpc1,
+        BGRLandmark::landmark_info_t& rinfo) const
+    {
+        const cv::Vec3f& pg0 = rpg0;
+        const cv::Vec3f& pg1 = rpg1;
+        const cv::Vec3f& pc0 = rpc0;
+        const cv::Vec3f& pc1 = rpc1;
+
         // get pixel value ranges for colored corners
         double p0max, p0min, p0rng;
         double p1max, p1min, p1rng;
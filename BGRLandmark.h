@@ -47,6 +47,20 @@ namespace cpoz
             double rmatch;      // sqdiff match metric
         } landmark_info_t;
 
+        typedef struct
+        {
+            landmark_info_t info;   // landmark info (center in full size image)
+            int level;              // pyramid level where landmark was found
+            double scale;           // estimated landmark size relative to template size
+        } landmark_scale_info_t;
+
+        // location and signed correlation of a local max in the match result
+        typedef struct
+        {
+            cv::Point pt;
+            float corr;
+        } candidate_t;
+
         // names of colors with 0 or 255 as the BGR components
         enum class bgr_t : int
         {
@@ -101,6 +115,27 @@ namespace cpoz
             cv::Mat& rtmatch,
             std::vector<BGRLandmark::landmark_info_t>& rpts);
 
+        // runs the match on a YUV420 NV12 camera frame (Y rows followed by interleaved UV rows)
+        // the Y plane is used as the gray image and only candidate ROIs are converted to BGR
+        // results are same as matching the frame converted to BGR with the Y plane as gray image
+        void perform_match(
+            const cv::Mat& rsrc_nv12,
+            cv::Mat& rtmatch,
+            std::vector<BGRLandmark::landmark_info_t>& rpts);
+
+        // runs the match on each level of a half-size pyramid of the BGR and gray images
+        // so landmarks larger than the template are found at coarser levels
+        // the template size is same at every level so total cost is about 1.33x of one level
+        // landmarks found at more than one level are merged (strongest is kept)
+        // and their scale is interpolated from the match values at the neighboring levels
+        // landmarks are sorted by strength and the match result is for the full size image
+        void perform_match_scales(
+            const cv::Mat& rsrc_bgr,
+            const cv::Mat& rsrc,
+            cv::Mat& rtmatch,
+            std::vector<BGRLandmark::landmark_scale_info_t>& rinfo,
+            const int levels = 4);
+
         const cv::Mat& get_template_p(void) const { return tmpl_gray_p; }
         const cv::Mat& get_template_n(void) const { return tmpl_gray_n; }
 
@@ -111,6 +146,28 @@ namespace cpoz
         // but it can be turned off for testing
         void set_color_id_enable(const bool f) { is_color_id_enabled = f; }
 
+        // the template is normally correlated with box sums from integral images
+        // but the generic matchTemplate correlation can be used for testing
+        void set_box_corr_enable(const bool f) { is_box_corr_enabled = f; }
+
+        // candidates are normally checked all at once from one buffer of their ROIs
+        // but they can be checked one at a time with OpenCV calls for testing
+        void set_batch_verify_enable(const bool f) { is_batch_verify_enabled = f; }
+
+        // optional prefilter that skips correlation in flat regions
+        // windows that fail the pixel range tests can't be landmarks so the landmarks are unchanged
+        // but the match result is 0 in skipped tiles
+        void set_prefilter_enable(const bool f) { is_prefilter_enabled = f; }
+
+        // finds local maxima (3x3) of absolute match result that are above threshold
+        // and writes absolute match result, all in one pass with no temporary images
+        // candidates are in same order as findNonZero (row-major)
+        // (public so it can be checked against the OpenCV calls it replaces)
+        void find_candidates(
+            const cv::Mat& rtmatch_signed,
+            cv::Mat& rtmatch,
+            std::vector<candidate_t>& rvcand) const;
+
 
         // creates printable 2x2 landmark image
         static void create_landmark_image(
@@ -149,10 +206,64 @@ namespace cpoz
             const int k,
             const grid_colors_t& rcolors);
 
+        // region of template with a constant pixel value
+        typedef struct
+        {
+            cv::Rect roi;
+            double val;
+        } tmpl_box_t;
+
+        // finds constant regions of the template (four squares, four seams, and center)
+        // returns false if template does not have that layout
+        bool create_template_boxes(void);
+
+        // performs same correlation as matchTemplate with TM_CCOEFF_NORMED
+        // but the template is a few constant boxes so the correlation and window
+        // stats come from integral images and cost does not depend on template size
+        void correlate_boxes(const cv::Mat& rsrc, cv::Mat& rtmatch);
+
+        // box correlation for a region of the match result
+        // integral images must be ready
+        void correlate_boxes_roi(const cv::Rect& rroi, cv::Mat& rtmatch) const;
+
+        // finds windowed min and max of gray image with separable van Herk/Gil-Werman filters
+        // and gets runs of match result tiles with windows that might pass the pixel range tests
+        void prefilter_tiles(const cv::Mat& rsrc, std::vector<cv::Rect>& rvruns);
+
+        // gets BGR pixels for a ROI of a BGR image (no copy) or an NV12 image (converted)
+        void get_bgr_roi(const cv::Mat& rsrc_color, const cv::Rect& rroi, cv::Mat& rdst) const;
+
+        // checks one candidate with the range, shape, and color tests
+        // and adds it to landmark info if it passes
+        void verify_candidate(
+            const cv::Mat& rsrc_color,
+            const cv::Mat& rsrc,
+            const candidate_t& rcand,
+            std::vector<BGRLandmark::landmark_info_t>& rinfo);
+
+        // checks all candidates with the same tests as verify_candidate
+        // the gray ROIs are gathered into one buffer and each test is a plain (SIMD) loop
+        // instead of separate OpenCV calls (with their overhead) for each ROI
+        // the equalized sqdiff test is done with integer sums over histogram bins
+        void verify_candidates_batch(
+            const cv::Mat& rsrc_color,
+            const cv::Mat& rsrc,
+            const std::vector<candidate_t>& rvcand,
+            std::vector<BGRLandmark::landmark_info_t>& rinfo);
+
         // takes landmark info and snapshot of landmark
         // and tries to identify the colors in the non-black squares
         void identify_colors(const cv::Mat& rimg, BGRLandmark::landmark_info_t& rinfo) const;
 
+        // tries to identify colors from the smoothed BGR samples of the two
+        // dark corners and the two colored corners
+        void identify_colors_samples(
+            const cv::Vec3f& rpg0,
+            const cv::Vec3f& rpg1,
+            const cv::Vec3f& rpc0,
+            const cv::Vec3f& rpc1,
+            BGRLandmark::landmark_info_t& rinfo) const;
+
         // EXPERIMENTAL (HSV threshold color match)
         void identify_colors_thr(const cv::Mat& rimg, BGRLandmark::landmark_info_t& rinfo) const;
 
@@ -182,6 +293,60 @@ namespace cpoz
         // flag for controlling color ID function
         bool is_color_id_enabled;
 
+        // flag for correlating with box sums
+        bool is_box_corr_enabled;
+
+        // constant regions of positive template and its mean and norm (mean subtracted)
+        // box correlation can only be used if the template was split into boxes
+        std::vector<tmpl_box_t> vtmpl_boxes;
+        double tmpl_mean;
+        double tmpl_norm;
+        bool is_tmpl_boxes_ok;
+
+        // integral images for box correlation
+        cv::Mat img_sum;
+        cv::Mat img_sqsum;
+
+        // flag for prefilter and size of its tiles
+        bool is_prefilter_enabled;
+        static const int PREFILTER_TILE = 32;
+
+        // prefilter buffers (row and column passes, windowed min and max, tile mask, tile runs)
+        std::vector<uchar> vprefilter_row;
+        cv::Mat prefilter_hmin;
+        cv::Mat prefilter_hmax;
+        cv::Mat prefilter_g;
+        cv::Mat prefilter_h;
+        cv::Mat prefilter_min;
+        cv::Mat prefilter_max;
+        cv::Mat prefilter_mask;
+        std::vector<cv::Rect> vprefilter_runs;
+
+        // image pyramids, match result, and landmarks for each level of scale-space search
+        std::vector<cv::Mat> vscale_bgr;
+        std::vector<cv::Mat> vscale_gray;
+        cv::Mat tmatch_scale;
+        std::vector<landmark_info_t> vinfo_scale;
+
+        // buffers for converting NV12 ROIs to BGR
+        mutable cv::Mat nv12_roi;
+        mutable cv::Mat nv12_roi_bgr;
+
+        // flag for checking candidates in a batch
+        bool is_batch_verify_enabled;
+
+        // candidates from last match
+        std::vector<candidate_t> vcandidates;
+
+        // buffers for batch checks (gray ROIs, ROI min and max)
+        std::vector<uchar> vbatch_gray;
+        std::vector<uchar> vbatch_min;
+        std::vector<uchar> vbatch_max;
+
+        // squared norms of the templates for batch checks
+        int tmpl_norm2_p;
+        int tmpl_norm2_n;
+
 #ifdef _COLLECT_SAMPLES
     public:
         const int sampx = 40;
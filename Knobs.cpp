@@ -30,6 +30,8 @@ Knobs::Knobs() :
     is_cal_enabled(false),
     is_equ_hist_enabled(false),
     is_mask_enabled(false),
+    is_pyramid_enabled(false),
+    is_tracking_enabled(false),
     is_record_enabled(false),
     is_snapshot_enabled(false),
     kpreblur(1),
@@ -74,7 +76,9 @@ void Knobs::show_help(void) const
     std::cout << "}   Increase Sobel kernel size" << std::endl;
     std::cout << "c   Toggle calibration image grab mode for BGRLandmark" << std::endl;
     std::cout << "e   Toggle histogram equalization" << std::endl;
+    std::cout << "k   Toggle tracking mode for template matching" << std::endl;
     std::cout << "m   Toggle mask mode for template matching" << std::endl;
+    std::cout << "p   Toggle pyramid search mode for template matching" << std::endl;
     std::cout << "r   Toggle recording mode" << std::endl;
     std::cout << "s   Set HSV snapshot mode for BGRLandmark (one-shot)" << std::endl;
     std::cout << "t   Select next template from collection" << std::endl;
@@ -176,11 +180,21 @@ void Knobs::handle_keypress(const char ckey)
             toggle_equ_hist_enabled();
             break;
         }
+        case 'k':
+        {
+            toggle_tracking_enabled();
+            break;
+        }
         case 'm':
         {
             toggle_mask_enabled();
             break;
         }
+        case 'p':
+        {
+            toggle_pyramid_enabled();
+            break;
+        }
         case 'r':
         {
             is_op_required = true;
@@ -226,6 +240,8 @@ void Knobs::handle_keypress(const char ckey)
         const std::vector<std::string> sout({ "Raw  ", "Mask ", "Color", "Aux  " });
         std::cout << "Equ=" << is_equ_hist_enabled;
         std::cout << "  Mask=" << is_mask_enabled;
+        std::cout << "  Pyr=" << is_pyramid_enabled;
+        std::cout << "  Trk=" << is_tracking_enabled;
         std::cout << "  Blur=" << kpreblur;
         std::cout << "  Clip=" << kcliplimit;
         std::cout << "  Ch=" << srgb[nchannel];
@@ -67,6 +67,12 @@ public:
     bool get_mask_enabled(void) const { return is_mask_enabled; }
     void toggle_mask_enabled(void) { is_mask_enabled = !is_mask_enabled; }
 
+    bool get_pyramid_enabled(void) const { return is_pyramid_enabled; }
+    void toggle_pyramid_enabled(void) { is_pyramid_enabled = !is_pyramid_enabled; }
+
+    bool get_tracking_enabled(void) const { return is_tracking_enabled; }
+    void toggle_tracking_enabled(void) { is_tracking_enabled = !is_tracking_enabled; }
+
     bool get_record_enabled(void) const { return is_record_enabled; }
     void toggle_record_enabled(void) { is_record_enabled = !is_record_enabled; }
 
@@ -112,6 +118,12 @@ private:
     // Flag for enabling mask in template matching
     bool is_mask_enabled;
 
+    // Flag for enabling coarse-to-fine pyramid search in template matching
+    bool is_pyramid_enabled;
+
+    // Flag for enabling predictive search window tracking in template matching
+    bool is_tracking_enabled;
+
     // Flag for enabling recording
     bool is_record_enabled;
 
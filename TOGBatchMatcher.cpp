@@ -0,0 +1,281 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include "TOGBatchMatcher.h"
+
+
+TOGBatchMatcher::TOGBatchMatcher() :
+    nthreads(0),
+    max_frames(TOG_BATCH_DEFAULT_MAX_FRAMES)
+{
+}
+
+
+TOGBatchMatcher::~TOGBatchMatcher()
+{
+}
+
+
+void TOGBatchMatcher::init(const int nthreads, const size_t max_frames)
+{
+    this->nthreads = nthreads;
+    this->max_frames = std::max<size_t>(max_frames, 1U);
+}
+
+
+size_t TOGBatchMatcher::perform_match(
+    const TOGMatcherBank& rbank,
+    frame_source_t source,
+    peak_sink_t sink,
+    const bool is_mask_enabled) const
+{
+    // frame that has been read but not matched
+    typedef struct
+    {
+        size_t n;
+        cv::Mat img;
+    } frame_job_t;
+
+    std::mutex mtx;
+    std::mutex mtx_sink;
+    std::condition_variable cv_work;
+    std::condition_variable cv_space;
+    std::deque<frame_job_t> qjobs;
+    std::map<size_t, std::vector<TOGMatcher::peak_info_t>> mready;
+    std::exception_ptr perr;
+    std::vector<std::thread> vthreads;
+    size_t n_read = 0U;
+    size_t n_next_report = 0U;
+    size_t n_in_flight = 0U;
+    bool is_done_reading = false;
+    bool is_failed = false;
+
+    // stops everything after an exception in any thread
+    // first exception is passed to the caller when all threads are done
+    auto fail = [&](void)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!is_failed)
+        {
+            perr = std::current_exception();
+            is_failed = true;
+        }
+        cv_work.notify_all();
+        cv_space.notify_all();
+    };
+
+    // reports every frame that is ready in frame order
+    // only one thread at a time can report so the sink is never called concurrently
+    auto report = [&](void)
+    {
+        std::lock_guard<std::mutex> lock_sink(mtx_sink);
+        while (true)
+        {
+            std::vector<TOGMatcher::peak_info_t> vpeaks;
+            size_t n;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                auto it = mready.find(n_next_report);
+                if (it == mready.end())
+                {
+                    break;
+                }
+                n = it->first;
+                vpeaks.swap(it->second);
+                mready.erase(it);
+            }
+
+            sink(n, vpeaks);
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                n_next_report++;
+                n_in_flight--;
+            }
+            cv_space.notify_one();
+        }
+    };
+
+    // each worker matches whole frames with its own buffers
+    // templates are matched one after another since the frames are already in parallel
+    auto work = [&](void)
+    {
+        cv::Mat gray;
+        cv::Mat grad_x;
+        cv::Mat grad_y;
+        cv::Mat tmatch;
+
+        while (true)
+        {
+            frame_job_t job;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv_work.wait(lock, [&] { return is_failed || is_done_reading || !qjobs.empty(); });
+                if (is_failed || qjobs.empty())
+                {
+                    break;
+                }
+                job = qjobs.front();
+                qjobs.pop_front();
+            }
+
+            try
+            {
+                std::vector<TOGMatcher::peak_info_t> vpeaks(rbank.size());
+
+                if (job.img.channels() == 3)
+                {
+                    cv::cvtColor(job.img, gray, cv::COLOR_BGR2GRAY);
+                }
+                else if (job.img.channels() == 4)
+                {
+                    cv::cvtColor(job.img, gray, cv::COLOR_BGRA2GRAY);
+                }
+                else
+                {
+                    gray = job.img;
+                }
+
+                // frame is not needed after the gradients are calculated
+                Sobel(gray, grad_x, CV_32F, 1, 0, rbank.get_ksize());
+                Sobel(gray, grad_y, CV_32F, 0, 1, rbank.get_ksize());
+                job.img.release();
+                gray.release();
+
+                for (size_t i = 0; i < rbank.size(); i++)
+                {
+                    TOGMatcher::peak_info_t& rpeak = vpeaks[i];
+                    rbank.get_matcher(i).perform_match_grad(grad_x, grad_y, tmatch, is_mask_enabled);
+                    cv::minMaxLoc(tmatch, nullptr, &rpeak.score, nullptr, &rpeak.pt);
+                    rpeak.ptsub = rpeak.pt;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    mready[job.n].swap(vpeaks);
+                }
+                report();
+            }
+            catch (...)
+            {
+                fail();
+                break;
+            }
+        }
+    };
+
+    const int nworkers = (nthreads > 0) ? nthreads : std::max(cv::getNumberOfCPUs(), 1);
+    for (int i = 0; i < nworkers; i++)
+    {
+        vthreads.push_back(std::thread(work));
+    }
+
+    // frames are read in this thread
+    // and reading waits whenever too many frames are in progress
+    while (true)
+    {
+        cv::Mat img;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv_space.wait(lock, [&] { return is_failed || (n_in_flight < max_frames); });
+            if (is_failed)
+            {
+                break;
+            }
+        }
+
+        try
+        {
+            if (!source(img) || img.empty())
+            {
+                break;
+            }
+        }
+        catch (...)
+        {
+            fail();
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            qjobs.push_back({ n_read, img });
+            n_read++;
+            n_in_flight++;
+        }
+        cv_work.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        is_done_reading = true;
+    }
+    cv_work.notify_all();
+
+    for (auto& r : vthreads)
+    {
+        r.join();
+    }
+
+    if (perr)
+    {
+        std::rethrow_exception(perr);
+    }
+
+    return n_read;
+}
+
+
+size_t TOGBatchMatcher::perform_match(
+    const TOGMatcherBank& rbank,
+    const std::vector<cv::Mat>& rvframes,
+    std::vector<std::vector<TOGMatcher::peak_info_t>>& rvvpeaks,
+    const bool is_mask_enabled) const
+{
+    size_t n = 0U;
+    rvvpeaks.resize(rvframes.size());
+    return perform_match(
+        rbank,
+        [&](cv::Mat& rimg)
+        {
+            bool result = (n < rvframes.size());
+            if (result)
+            {
+                rimg = rvframes[n];
+                n++;
+            }
+            return result;
+        },
+        [&](const size_t k, const std::vector<TOGMatcher::peak_info_t>& rvpeaks)
+        {
+            rvvpeaks[k] = rvpeaks;
+        },
+        is_mask_enabled);
+}
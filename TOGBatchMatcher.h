@@ -0,0 +1,92 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+
+#ifndef TOG_BATCH_MATCHER_H_
+#define TOG_BATCH_MATCHER_H_
+
+#include <functional>
+#include <vector>
+#include "opencv2/imgproc.hpp"
+#include "TOGMatcher.h"
+#include "TOGMatcherBank.h"
+
+
+// Maximum number of frames that can be decoded but not yet reported at one time
+// This bounds the memory used by a batch to about this many frames and their gradients
+#define TOG_BATCH_DEFAULT_MAX_FRAMES    (16)
+
+
+// Matches a bank of templates against a long sequence of frames (such as a video file).
+// One thread reads frames from the source while worker threads calculate the gradients
+// and match all the templates for different frames at the same time.  The best match
+// for each template is reported for every frame in the same order as the frames were read.
+class TOGBatchMatcher
+{
+public:
+
+    // gets next frame, returns false when there are no more frames
+    typedef std::function<bool(cv::Mat&)> frame_source_t;
+
+    // gets frame number and best match (max) for each template in bank
+    // this is always called in frame order and never from two threads at once
+    typedef std::function<void(const size_t, const std::vector<TOGMatcher::peak_info_t>&)> peak_sink_t;
+
+    TOGBatchMatcher();
+    virtual ~TOGBatchMatcher();
+
+    // sets number of worker threads (0 for one per CPU)
+    // and limit on number of frames in progress
+    void init(
+        const int nthreads = 0,
+        const size_t max_frames = TOG_BATCH_DEFAULT_MAX_FRAMES);
+
+    // matches bank against every frame from source and reports the peaks for each frame
+    // color frames are converted to gray before matching
+    // returns number of frames processed
+    size_t perform_match(
+        const TOGMatcherBank& rbank,
+        frame_source_t source,
+        peak_sink_t sink,
+        const bool is_mask_enabled = true) const;
+
+    // matches bank against a range of frames that are already in memory
+    // there is one vector of peaks for each frame
+    size_t perform_match(
+        const TOGMatcherBank& rbank,
+        const std::vector<cv::Mat>& rvframes,
+        std::vector<std::vector<TOGMatcher::peak_info_t>>& rvvpeaks,
+        const bool is_mask_enabled = true) const;
+
+    int get_nthreads(void) const { return nthreads; }
+    size_t get_max_frames(void) const { return max_frames; }
+
+private:
+
+    // Number of worker threads (0 for one per CPU)
+    int nthreads;
+
+    // Limit on number of frames that have been read but not reported
+    size_t max_frames;
+};
+
+#endif // TOG_BATCH_MATCHER_H_
@@ -0,0 +1,519 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifdef _WIN32
+#include "Windows.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include <fstream>
+#include "opencv2/imgcodecs.hpp"
+#include "TOGLibrary.h"
+
+
+static const char LIBRARY_MAGIC[4] = { 'T', 'O', 'G', 'L' };
+
+
+
+// rounds file position up so data blocks are 8-byte aligned in the mapped file
+static inline uint64_t align8(const uint64_t pos)
+{
+    return (pos + 7U) & ~static_cast<uint64_t>(7U);
+}
+
+
+
+// returns size in bytes of contour data block
+static uint64_t contour_data_size(const std::vector<std::vector<cv::Point>>& rcontours)
+{
+    uint64_t result = sizeof(int32_t);
+    for (const auto& r : rcontours)
+    {
+        result += sizeof(int32_t) + (r.size() * 2 * sizeof(int32_t));
+    }
+    return result;
+}
+
+
+
+// gets size and modification time of a file
+// so templates can be recompiled when their source image changes
+static bool get_file_stamp(const std::string& rspath, uint64_t& rsize, int64_t& rmtime)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExA(rspath.c_str(), GetFileExInfoStandard, &fad))
+    {
+        ///////
+        return false;
+        ///////
+    }
+    rsize = (static_cast<uint64_t>(fad.nFileSizeHigh) << 32) | fad.nFileSizeLow;
+    rmtime = static_cast<int64_t>((static_cast<uint64_t>(fad.ftLastWriteTime.dwHighDateTime) << 32) | fad.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat st;
+    if (stat(rspath.c_str(), &st) != 0)
+    {
+        ///////
+        return false;
+        ///////
+    }
+    rsize = static_cast<uint64_t>(st.st_size);
+    rmtime = static_cast<int64_t>(st.st_mtime);
+#endif
+    return true;
+}
+
+
+
+TOGLibrary::TOGLibrary() :
+    pmap(nullptr),
+    map_size(0U),
+    hfile(nullptr),
+    hmap(nullptr)
+{
+}
+
+
+TOGLibrary::~TOGLibrary()
+{
+    unmap_file();
+}
+
+
+void TOGLibrary::clear(void)
+{
+    ventries.clear();
+    index.clear();
+    unmap_file();
+}
+
+
+void TOGLibrary::add_template_from_file(
+    const std::string& rsname,
+    const std::string& rspath,
+    const int ksize,
+    const double mag_thr)
+{
+    // get file stamp first so a file changed while compiling is seen as stale later
+    uint64_t src_size = 0U;
+    int64_t src_mtime = 0;
+    get_file_stamp(rspath, src_size, src_mtime);
+
+    TOGMatcher togm;
+    togm.set_pyramid_params(0);
+    togm.create_template_from_file(rspath.c_str(), ksize, mag_thr);
+    entry_t e = make_entry(rsname, togm, ksize, mag_thr);
+    e.src_size = src_size;
+    e.src_mtime = src_mtime;
+    add_entry(e);
+}
+
+
+bool TOGLibrary::update_template_from_file(
+    const std::string& rsname,
+    const std::string& rspath,
+    const int ksize,
+    const double mag_thr)
+{
+    uint64_t src_size = 0U;
+    int64_t src_mtime = 0;
+    get_file_stamp(rspath, src_size, src_mtime);
+
+    auto iter = index.find(std::make_pair(rsname.substr(0, TOG_LIBRARY_NAME_LEN - 1), ksize));
+    if (iter != index.end())
+    {
+        const entry_t& re = ventries[iter->second];
+        if ((re.mag_thr == mag_thr) && (re.src_size == src_size) && (re.src_mtime == src_mtime))
+        {
+            ///////
+            return false;
+            ///////
+        }
+    }
+
+    add_template_from_file(rsname, rspath, ksize, mag_thr);
+    return true;
+}
+
+
+void TOGLibrary::add_template_from_matcher(
+    const std::string& rsname,
+    const TOGMatcher& rmatcher,
+    const int ksize,
+    const double mag_thr)
+{
+    add_entry(make_entry(rsname, rmatcher, ksize, mag_thr));
+}
+
+
+bool TOGLibrary::save(const std::string& rspath) const
+{
+    // the mapped images would be lost when the file is truncated
+    if ((pmap != nullptr) && (rspath == smap_path))
+    {
+        ///////
+        return false;
+        ///////
+    }
+
+    std::ofstream ofs(rspath, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open())
+    {
+        ///////
+        return false;
+        ///////
+    }
+
+    const char zeros[8] = { 0 };
+    file_header_t hdr;
+    std::memcpy(hdr.magic, LIBRARY_MAGIC, sizeof(hdr.magic));
+    hdr.version = TOG_LIBRARY_VERSION;
+    hdr.count = static_cast<uint32_t>(ventries.size());
+    hdr.entry_size = sizeof(file_entry_t);
+
+    // build table with position of data for every template
+    std::vector<file_entry_t> vtable(ventries.size());
+    uint64_t pos = align8(sizeof(file_header_t) + (vtable.size() * sizeof(file_entry_t)));
+    for (size_t i = 0; i < ventries.size(); i++)
+    {
+        const entry_t& re = ventries[i];
+        file_entry_t& rt = vtable[i];
+        std::memset(&rt, 0, sizeof(rt));
+        std::strncpy(rt.sname, re.sname.c_str(), TOG_LIBRARY_NAME_LEN - 1);
+        rt.ksize = re.ksize;
+        rt.rows = re.dx.rows;
+        rt.cols = re.dx.cols;
+        rt.offset_x = re.offset.x;
+        rt.offset_y = re.offset.y;
+        rt.mag_thr = re.mag_thr;
+        rt.src_size = re.src_size;
+        rt.src_mtime = re.src_mtime;
+        rt.data_pos = pos;
+        pos = align8(pos + (3U * re.dx.total() * sizeof(float)));
+        rt.contour_pos = pos;
+        pos = align8(pos + contour_data_size(re.contours));
+    }
+
+    ofs.write(reinterpret_cast<const char *>(&hdr), sizeof(hdr));
+    ofs.write(reinterpret_cast<const char *>(vtable.data()), vtable.size() * sizeof(file_entry_t));
+
+    for (size_t i = 0; i < ventries.size(); i++)
+    {
+        const entry_t& re = ventries[i];
+
+        // pad up to start of data
+        ofs.write(zeros, static_cast<std::streamsize>(vtable[i].data_pos - static_cast<uint64_t>(ofs.tellp())));
+        for (const cv::Mat * pimg : { &re.dx, &re.dy, &re.mask })
+        {
+            for (int j = 0; j < pimg->rows; j++)
+            {
+                ofs.write(pimg->ptr<char>(j), pimg->cols * sizeof(float));
+            }
+        }
+
+        // pad up to start of contours
+        ofs.write(zeros, static_cast<std::streamsize>(vtable[i].contour_pos - static_cast<uint64_t>(ofs.tellp())));
+        const int32_t ncontours = static_cast<int32_t>(re.contours.size());
+        ofs.write(reinterpret_cast<const char *>(&ncontours), sizeof(ncontours));
+        for (const auto& rc : re.contours)
+        {
+            const int32_t npts = static_cast<int32_t>(rc.size());
+            ofs.write(reinterpret_cast<const char *>(&npts), sizeof(npts));
+            for (const auto& rpt : rc)
+            {
+                const int32_t xy[2] = { rpt.x, rpt.y };
+                ofs.write(reinterpret_cast<const char *>(xy), sizeof(xy));
+            }
+        }
+    }
+
+    return ofs.good();
+}
+
+
+bool TOGLibrary::load(const std::string& rspath)
+{
+    clear();
+    if (!map_file(rspath))
+    {
+        ///////
+        return false;
+        ///////
+    }
+
+    // check header
+    const file_header_t * phdr = reinterpret_cast<const file_header_t *>(pmap);
+    bool is_ok =
+        (map_size >= sizeof(file_header_t)) &&
+        (std::memcmp(phdr->magic, LIBRARY_MAGIC, sizeof(phdr->magic)) == 0) &&
+        (phdr->version == TOG_LIBRARY_VERSION) &&
+        (phdr->entry_size == sizeof(file_entry_t)) &&
+        ((sizeof(file_header_t) + (static_cast<uint64_t>(phdr->count) * sizeof(file_entry_t))) <= map_size);
+
+    // images point directly into the mapped file
+    // only the contours have to be unpacked
+    const file_entry_t * ptable = reinterpret_cast<const file_entry_t *>(pmap + sizeof(file_header_t));
+    for (uint32_t i = 0; is_ok && (i < phdr->count); i++)
+    {
+        // sizes and positions are checked so no sum can wrap around
+        // and positions must be aligned for reading float and int32 data in place
+        const file_entry_t& rt = ptable[i];
+        is_ok =
+            (rt.rows > 0) && (rt.cols > 0) &&
+            (static_cast<uint64_t>(rt.cols) <= ((map_size / (3U * sizeof(float))) / static_cast<uint64_t>(rt.rows))) &&
+            (rt.sname[TOG_LIBRARY_NAME_LEN - 1] == 0) &&
+            ((rt.data_pos % sizeof(float)) == 0) &&
+            ((rt.contour_pos % sizeof(int32_t)) == 0) &&
+            (rt.data_pos <= map_size) &&
+            ((3U * static_cast<uint64_t>(rt.rows) * rt.cols * sizeof(float)) <= (map_size - rt.data_pos)) &&
+            (rt.contour_pos < map_size) &&
+            (sizeof(int32_t) <= (map_size - rt.contour_pos));
+        if (!is_ok)
+        {
+            break;
+        }
+
+        // the mapping is read-only so these images must never be written (see entry_t)
+        entry_t e;
+        float * pdata = reinterpret_cast<float *>(const_cast<uint8_t *>(pmap + rt.data_pos));
+        e.sname = rt.sname;
+        e.ksize = rt.ksize;
+        e.mag_thr = rt.mag_thr;
+        e.dx = cv::Mat(rt.rows, rt.cols, CV_32F, pdata);
+        e.dy = cv::Mat(rt.rows, rt.cols, CV_32F, pdata + e.dx.total());
+        e.mask = cv::Mat(rt.rows, rt.cols, CV_32F, pdata + (2 * e.dx.total()));
+        e.offset = { rt.offset_x, rt.offset_y };
+        e.src_size = rt.src_size;
+        e.src_mtime = rt.src_mtime;
+
+        const int32_t * pc = reinterpret_cast<const int32_t *>(pmap + rt.contour_pos);
+        const int32_t * pcend = pc + ((map_size - rt.contour_pos) / sizeof(int32_t));
+        const int32_t ncontours = *pc++;
+
+        // each contour takes at least one value so a bigger count can't be valid
+        is_ok = (ncontours >= 0) && (ncontours <= (pcend - pc));
+        if (is_ok)
+        {
+            e.contours.resize(ncontours);
+        }
+        for (int32_t k = 0; is_ok && (k < ncontours); k++)
+        {
+            is_ok = (pc < pcend) && (*pc >= 0) && ((pcend - pc - 1) >= (2 * static_cast<int64_t>(*pc)));
+            if (is_ok)
+            {
+                const int32_t npts = *pc++;
+                e.contours[k].resize(npts);
+                for (int32_t n = 0; n < npts; n++)
+                {
+                    e.contours[k][n] = { pc[0], pc[1] };
+                    pc += 2;
+                }
+            }
+        }
+
+        if (is_ok)
+        {
+            index[std::make_pair(e.sname, e.ksize)] = ventries.size();
+            ventries.push_back(e);
+        }
+    }
+
+    if (!is_ok)
+    {
+        clear();
+    }
+
+    return is_ok;
+}
+
+
+bool TOGLibrary::get_template(
+    const std::string& rsname,
+    const int ksize,
+    const double mag_thr,
+    TOGMatcher& rmatcher) const
+{
+    auto iter = index.find(std::make_pair(rsname, ksize));
+    if ((iter == index.end()) || (ventries[iter->second].mag_thr != mag_thr))
+    {
+        ///////
+        return false;
+        ///////
+    }
+
+    const entry_t& re = ventries[iter->second];
+    rmatcher.create_template_from_compiled(re.dx, re.dy, re.mask, re.contours, re.offset, re.mag_thr);
+    return true;
+}
+
+
+TOGLibrary::entry_t TOGLibrary::make_entry(
+    const std::string& rsname,
+    const TOGMatcher& rmatcher,
+    const int ksize,
+    const double mag_thr) const
+{
+    entry_t e;
+    e.sname = rsname.substr(0, TOG_LIBRARY_NAME_LEN - 1);
+    e.ksize = ksize;
+    e.mag_thr = mag_thr;
+    e.dx = rmatcher.get_template_dx().clone();
+    e.dy = rmatcher.get_template_dy().clone();
+    e.mask = rmatcher.get_template_mask().clone();
+    e.contours = rmatcher.get_contours();
+    e.offset = rmatcher.get_template_offset();
+    e.src_size = 0U;
+    e.src_mtime = 0;
+    return e;
+}
+
+
+void TOGLibrary::add_entry(const entry_t& re)
+{
+    // library is being changed so it can no longer depend on the mapped file
+    copy_mapped_data();
+
+    // a new template with the same key replaces the old one
+    const auto key = std::make_pair(re.sname, re.ksize);
+    auto iter = index.find(key);
+    if (iter != index.end())
+    {
+        ventries[iter->second] = re;
+    }
+    else
+    {
+        index[key] = ventries.size();
+        ventries.push_back(re);
+    }
+}
+
+
+void TOGLibrary::copy_mapped_data(void)
+{
+    if (pmap == nullptr)
+    {
+        ///////
+        return;
+        ///////
+    }
+
+    for (auto& re : ventries)
+    {
+        re.dx = re.dx.clone();
+        re.dy = re.dy.clone();
+        re.mask = re.mask.clone();
+    }
+    unmap_file();
+}
+
+
+bool TOGLibrary::map_file(const std::string& rspath)
+{
+#ifdef _WIN32
+    LARGE_INTEGER file_size;
+    HANDLE h = CreateFileA(rspath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        ///////
+        return false;
+        ///////
+    }
+    hfile = h;
+    if (!GetFileSizeEx(h, &file_size) || (file_size.QuadPart == 0))
+    {
+        unmap_file();
+        ///////
+        return false;
+        ///////
+    }
+    hmap = CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (hmap != nullptr)
+    {
+        pmap = static_cast<const uint8_t *>(MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0));
+    }
+    map_size = static_cast<size_t>(file_size.QuadPart);
+#else
+    struct stat st;
+    int fd = open(rspath.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        ///////
+        return false;
+        ///////
+    }
+    if ((fstat(fd, &st) == 0) && (st.st_size > 0))
+    {
+        void * p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p != MAP_FAILED)
+        {
+            pmap = static_cast<const uint8_t *>(p);
+            map_size = static_cast<size_t>(st.st_size);
+        }
+    }
+    close(fd);
+#endif
+
+    if (pmap == nullptr)
+    {
+        unmap_file();
+    }
+    else
+    {
+        smap_path = rspath;
+    }
+    return (pmap != nullptr);
+}
+
+
+void TOGLibrary::unmap_file(void)
+{
+#ifdef _WIN32
+    if (pmap != nullptr)
+    {
+        UnmapViewOfFile(pmap);
+    }
+    if (hmap != nullptr)
+    {
+        CloseHandle(hmap);
+    }
+    if (hfile != nullptr)
+    {
+        CloseHandle(hfile);
+    }
+#else
+    if (pmap != nullptr)
+    {
+        munmap(const_cast<uint8_t *>(pmap), map_size);
+    }
+#endif
+    smap_path.clear();
+    pmap = nullptr;
+    map_size = 0U;
+    hfile = nullptr;
+    hmap = nullptr;
+}
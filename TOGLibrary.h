@@ -0,0 +1,188 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef TOG_LIBRARY_H_
+#define TOG_LIBRARY_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "opencv2/imgproc.hpp"
+#include "TOGMatcher.h"
+
+
+// Version of binary library file format
+// Files with any other version are rejected
+#define TOG_LIBRARY_VERSION     (2)
+
+// Maximum length of a template name (including terminating null)
+#define TOG_LIBRARY_NAME_LEN    (64)
+
+
+// Library of compiled TOGMatcher templates that can be saved to one binary file.
+// A saved library is loaded by memory-mapping the file so no template data
+// is recalculated or even read until a template is used.  Templates are looked up
+// by name and Sobel kernel size so switching kernel size is just another lookup.
+// Each template records the size and modification time of its source image file
+// so templates can be recompiled when the image or magnitude threshold changes.
+//
+// File layout (native byte order):
+//   header
+//   table of entries (one per template)
+//   data for each template:
+//     dX, dY, and mask (rows x cols CV_32F each)
+//     number of contours then for each contour: number of points, then (x,y) pairs
+class TOGLibrary
+{
+public:
+
+    // start of library file
+    typedef struct
+    {
+        char magic[4];          // "TOGL"
+        uint32_t version;       // TOG_LIBRARY_VERSION
+        uint32_t count;         // number of templates
+        uint32_t entry_size;    // size of each table entry
+    } file_header_t;
+
+    // table entry for one template
+    typedef struct
+    {
+        char sname[TOG_LIBRARY_NAME_LEN];
+        int32_t ksize;
+        int32_t rows;
+        int32_t cols;
+        int32_t offset_x;
+        int32_t offset_y;
+        int32_t reserved;
+        double mag_thr;
+        uint64_t data_pos;      // file position of dX, dY, and mask data
+        uint64_t contour_pos;   // file position of contour data
+        uint64_t src_size;      // size of source image file (0 if none)
+        int64_t src_mtime;      // modification time of source image file (0 if none)
+    } file_entry_t;
+
+    TOGLibrary();
+    virtual ~TOGLibrary();
+
+    // library may own a mapped file so it cannot be copied
+    TOGLibrary(const TOGLibrary&) = delete;
+    TOGLibrary& operator=(const TOGLibrary&) = delete;
+
+    // clears library and releases any mapped file
+    void clear(void);
+
+    // compiles a template from an image file and adds it to the library
+    // the name is the key for looking up the template later
+    void add_template_from_file(
+        const std::string& rsname,
+        const std::string& rspath,
+        const int ksize = TOG_DEFAULT_KSIZE,
+        const double mag_thr = TOG_DEFAULT_MAG_THR);
+
+    // compiles a template from an image file only if it is not in the library
+    // or if the image file or magnitude threshold changed since it was compiled
+    // returns true if template was compiled
+    bool update_template_from_file(
+        const std::string& rsname,
+        const std::string& rspath,
+        const int ksize = TOG_DEFAULT_KSIZE,
+        const double mag_thr = TOG_DEFAULT_MAG_THR);
+
+    void add_template_from_matcher(
+        const std::string& rsname,
+        const TOGMatcher& rmatcher,
+        const int ksize,
+        const double mag_thr);
+
+    // writes all templates to a library file
+    // fails if the library is still mapped from the same file
+    // (adding a template copies the mapped data and releases the file)
+    bool save(const std::string& rspath) const;
+
+    // replaces contents of library with templates from a library file
+    // the file stays mapped until the library is cleared or destroyed
+    bool load(const std::string& rspath);
+
+    // creates template in a matcher from the library
+    // returns false if template is not in library or was made with a different magnitude threshold
+    bool get_template(
+        const std::string& rsname,
+        const int ksize,
+        const double mag_thr,
+        TOGMatcher& rmatcher) const;
+
+    size_t size(void) const { return ventries.size(); }
+
+private:
+
+    // one template in library
+    // images may be owned or may point into the mapped file
+    // the mapping is read-only so the images must be treated as const data
+    // (anything that writes them in place would fault, so they are cloned when used)
+    typedef struct
+    {
+        std::string sname;
+        int ksize;
+        double mag_thr;
+        cv::Mat dx;
+        cv::Mat dy;
+        cv::Mat mask;
+        std::vector<std::vector<cv::Point>> contours;
+        cv::Point offset;
+        uint64_t src_size;
+        int64_t src_mtime;
+    } entry_t;
+
+    entry_t make_entry(
+        const std::string& rsname,
+        const TOGMatcher& rmatcher,
+        const int ksize,
+        const double mag_thr) const;
+
+    void add_entry(const entry_t& re);
+
+    // copies any images that point into the mapped file then releases the file
+    void copy_mapped_data(void);
+
+    bool map_file(const std::string& rspath);
+
+    void unmap_file(void);
+
+    // All templates
+    std::vector<entry_t> ventries;
+
+    // Index of each template by name and kernel size
+    std::map<std::pair<std::string, int>, size_t> index;
+
+    // Mapped library file
+    std::string smap_path;
+    const uint8_t * pmap;
+    size_t map_size;
+
+    // OS handles for mapped file
+    void * hfile;
+    void * hmap;
+};
+
+#endif // TOG_LIBRARY_H_
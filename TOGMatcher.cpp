@@ -20,15 +20,507 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
 #include "opencv2/highgui.hpp"
+#include "opencv2/core/hal/intrin.hpp"
 #include "TOGMatcher.h"
 
 
 const int TEMPLATE_DEPTH = CV_32F;
 
 
+
+// calculates sum of squared pixels for every template-sized window from an integral image of squares
+// output is same size as a matchTemplate result
+static void window_sum_sq_integral(const cv::Mat& risqsum, const cv::Size& rtsize, cv::Mat& rdst)
+{
+    const int nrows = risqsum.rows - rtsize.height;
+    const int ncols = risqsum.cols - rtsize.width;
+    rdst.create(nrows, ncols, TEMPLATE_DEPTH);
+    for (int j = 0; j < nrows; j++)
+    {
+        const double * p0 = risqsum.ptr<double>(j);
+        const double * p1 = risqsum.ptr<double>(j + rtsize.height);
+        float * pdst = rdst.ptr<float>(j);
+        for (int i = 0; i < ncols; i++)
+        {
+            const int k = i + rtsize.width;
+            pdst[i] = static_cast<float>((p1[k] - p1[i]) - (p0[k] - p0[i]));
+        }
+    }
+}
+
+
+
+// calculates sum of squared pixels for every template-sized window in an image
+// output is same size as a matchTemplate result
+static void window_sum_sq(const cv::Mat& rimg, const cv::Size& rtsize, cv::Mat& rdst)
+{
+    cv::Mat isum;
+    cv::Mat isqsum;
+    cv::integral(rimg, isum, isqsum, CV_64F, CV_64F);
+    window_sum_sq_integral(isqsum, rtsize, rdst);
+}
+
+
+
+// factors a template with an SVD and keeps the largest components
+// until the kept energy reaches a fraction of the total or the limit is reached
+static void factor_lowrank(
+    const cv::Mat& rtmpl,
+    const double energy,
+    const int max_rank,
+    TOGMatcher::lowrank_tmpl_t& rlowrank)
+{
+    cv::Mat w;
+    cv::Mat u;
+    cv::Mat vt;
+    cv::SVD::compute(rtmpl, w, u, vt);
+
+    double total = 0.0;
+    for (int k = 0; k < w.rows; k++)
+    {
+        total += w.at<float>(k) * w.at<float>(k);
+    }
+
+    rlowrank.vcol.clear();
+    rlowrank.vrow.clear();
+    rlowrank.norm2 = 0.0;
+    for (int k = 0; (k < w.rows) && (k < max_rank) && (rlowrank.norm2 < energy * total); k++)
+    {
+        const double q = w.at<float>(k);
+        if (q <= 0.0)
+        {
+            break;
+        }
+        rlowrank.vcol.push_back(u.col(k) * q);
+        rlowrank.vrow.push_back(vt.row(k).clone());
+        rlowrank.norm2 += q * q;
+    }
+
+    // singular values are the only thing that is discarded so the error is easy
+    rlowrank.err = (total > 0.0) ? std::sqrt(std::max(total - rlowrank.norm2, 0.0) / total) : 0.0;
+}
+
+
+
+// normalizes one raw correlation value like TM_CCORR_NORMED
+// divides by square root of image window energy times template norm
+// uses same rules as OpenCV for windows where the result would blow up
+static inline double ccorr_normalize_value(
+    double num,
+    const double energy,
+    const double tnorm,
+    const double energy_min)
+{
+    double t = (energy > energy_min) ? std::sqrt(energy) * tnorm : 0.0;
+    if (std::fabs(num) < t)
+    {
+        num /= t;
+    }
+    else if (std::fabs(num) < t * 1.125)
+    {
+        num = (num > 0) ? 1.0 : -1.0;
+    }
+    else
+    {
+        num = 0.0;
+    }
+    return num;
+}
+
+
+
+// normalizes a raw correlation result like TM_CCORR_NORMED
+static void ccorr_normalize(
+    const cv::Mat& rnum,
+    const cv::Mat& renergy,
+    const double tnorm2,
+    cv::Mat& rdst,
+    const double energy_min = 0.0)
+{
+    const double tnorm = std::sqrt(tnorm2);
+    rdst.create(rnum.size(), TEMPLATE_DEPTH);
+    for (int j = 0; j < rnum.rows; j++)
+    {
+        const float * pnum = rnum.ptr<float>(j);
+        const float * pen = renergy.ptr<float>(j);
+        float * pdst = rdst.ptr<float>(j);
+        for (int i = 0; i < rnum.cols; i++)
+        {
+            pdst[i] = static_cast<float>(ccorr_normalize_value(pnum[i], pen[i], tnorm, energy_min));
+        }
+    }
+}
+
+
+
+// adds scaled row to accumulator row: pacc[i] += k * psrc[i]
+// this is the inner loop of all the row-based correlations
+static void accumulate_scaled_row(float * pacc, const float * psrc, const float k, const int n)
+{
+    int i = 0;
+#if CV_SIMD
+    const cv::v_float32 vk = cv::vx_setall_f32(k);
+    for (; i <= n - cv::v_float32::nlanes; i += cv::v_float32::nlanes)
+    {
+        cv::v_float32 vacc = cv::vx_load(pacc + i);
+        cv::v_store(pacc + i, cv::v_muladd(vk, cv::vx_load(psrc + i), vacc));
+    }
+#endif
+    for (; i < n; i++)
+    {
+        pacc[i] += k * psrc[i];
+    }
+}
+
+
+
+// adds scaled CV_16S row to int32 accumulator row: pacc[i] += k * psrc[i]
+static void accumulate_scaled_row_16s(int * pacc, const short * psrc, const short k, const int n)
+{
+    int i = 0;
+#if CV_SIMD
+    const cv::v_int16 vk = cv::vx_setall_s16(k);
+    for (; i <= n - cv::v_int16::nlanes; i += cv::v_int16::nlanes)
+    {
+        cv::v_int32 vlo;
+        cv::v_int32 vhi;
+        cv::v_mul_expand(cv::vx_load(psrc + i), vk, vlo, vhi);
+        cv::v_store(pacc + i, cv::vx_load(pacc + i) + vlo);
+        cv::v_store(pacc + i + cv::v_int32::nlanes, cv::vx_load(pacc + i + cv::v_int32::nlanes) + vhi);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        pacc[i] += k * psrc[i];
+    }
+}
+
+
+
+// adds squared CV_16S row to int32 accumulator row: pacc[i] += psrc[i] * psrc[i]
+static void accumulate_square_row_16s(int * pacc, const short * psrc, const int n)
+{
+    int i = 0;
+#if CV_SIMD
+    for (; i <= n - cv::v_int16::nlanes; i += cv::v_int16::nlanes)
+    {
+        cv::v_int32 vlo;
+        cv::v_int32 vhi;
+        const cv::v_int16 vsrc = cv::vx_load(psrc + i);
+        cv::v_mul_expand(vsrc, vsrc, vlo, vhi);
+        cv::v_store(pacc + i, cv::vx_load(pacc + i) + vlo);
+        cv::v_store(pacc + i + cv::v_int32::nlanes, cv::vx_load(pacc + i + cv::v_int32::nlanes) + vhi);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        pacc[i] += psrc[i] * psrc[i];
+    }
+}
+
+
+
+// returns largest possible CV_16S gradient magnitude (X or Y) for an 8-bit image
+// or 0 if the kernel size is not supported for CV_16S matching
+static int max_int16_gradient(const int ksize)
+{
+    int result = 0;
+    switch (ksize)
+    {
+        case -1: result = 16 * 255; break;  // Scharr
+        case 1: result = 255; break;        // central difference
+        case 3: result = 4 * 255; break;    // 3x3 Sobel
+        default: break;
+    }
+    return result;
+}
+
+
+
+// adds row of sums of n consecutive pixels to accumulator row: pacc[i] += sum(psrc[i...i+n-1])
+// sums are updated incrementally and accumulated in double precision
+static void accumulate_box_row(float * pacc, const float * psrc, const int n, const int ncols)
+{
+    double q = 0.0;
+    for (int j = 0; j < n; j++)
+    {
+        q += psrc[j];
+    }
+    for (int i = 0; i < ncols; i++)
+    {
+        pacc[i] += static_cast<float>(q);
+        if (i < ncols - 1)
+        {
+            q += static_cast<double>(psrc[i + n]) - psrc[i];
+        }
+    }
+}
+
+
+
+// calculates one row of X and Y gradients (and their squares) from an 8-bit image
+// this is the same as Sobel with ksize=1 and default border (reflect 101)
+// pixels outside a region of interest are used if they exist in the parent image
+static void central_diff_row(
+    const cv::Mat& rsrc,
+    const int r,
+    float * pgx,
+    float * pgy,
+    float * pgx2,
+    float * pgy2)
+{
+    cv::Size whole_size;
+    cv::Point ofs;
+    rsrc.locateROI(whole_size, ofs);
+
+    const int ncols = rsrc.cols;
+    const uchar * p = rsrc.ptr<uchar>(r);
+    const uchar * pprev;
+    const uchar * pnext;
+
+    // neighbor rows with border reflection
+    if ((r > 0) || (ofs.y > 0))
+    {
+        pprev = p - rsrc.step;
+    }
+    else
+    {
+        pprev = rsrc.ptr<uchar>((rsrc.rows > 1) ? 1 : 0);
+    }
+
+    if ((r < rsrc.rows - 1) || (ofs.y + rsrc.rows < whole_size.height))
+    {
+        pnext = p + rsrc.step;
+    }
+    else
+    {
+        pnext = rsrc.ptr<uchar>((rsrc.rows > 1) ? rsrc.rows - 2 : 0);
+    }
+
+    // neighbor pixels at ends of row with border reflection
+    const int xl = (ofs.x > 0) ? p[-1] : p[(ncols > 1) ? 1 : 0];
+    const int xr = (ofs.x + ncols < whole_size.width) ? p[ncols] : p[(ncols > 1) ? ncols - 2 : 0];
+
+    for (int i = 0; i < ncols; i++)
+    {
+        int a = (i > 0) ? p[i - 1] : xl;
+        int b = (i < ncols - 1) ? p[i + 1] : xr;
+        float gx = static_cast<float>(b - a);
+        float gy = static_cast<float>(pnext[i] - pprev[i]);
+        pgx[i] = gx;
+        pgy[i] = gy;
+        pgx2[i] = gx * gx;
+        pgy2[i] = gy * gy;
+    }
+}
+
+
+
+// calculates X and Y gradient images (and their squares) into workspace buffers
+// the buffers are only allocated if the image size changes
+static void calc_workspace_gradients(const cv::Mat& rsrc, const int ksize, TOGMatchWorkspace& rws)
+{
+    rws.grad_x.create(rsrc.size(), TEMPLATE_DEPTH);
+    rws.grad_y.create(rsrc.size(), TEMPLATE_DEPTH);
+    rws.grad_x2.create(rsrc.size(), TEMPLATE_DEPTH);
+    rws.grad_y2.create(rsrc.size(), TEMPLATE_DEPTH);
+
+    if ((ksize == 1) && (rsrc.type() == CV_8UC1))
+    {
+        for (int r = 0; r < rsrc.rows; r++)
+        {
+            central_diff_row(
+                rsrc, r,
+                rws.grad_x.ptr<float>(r), rws.grad_y.ptr<float>(r),
+                rws.grad_x2.ptr<float>(r), rws.grad_y2.ptr<float>(r));
+        }
+    }
+    else
+    {
+        Sobel(rsrc, rws.grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
+        Sobel(rsrc, rws.grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+        cv::multiply(rws.grad_x, rws.grad_x, rws.grad_x2);
+        cv::multiply(rws.grad_y, rws.grad_y, rws.grad_y2);
+    }
+}
+
+
+
+// correlates a real image with a template using a cached template spectrum
+// the spectrum must be a conjugate-ready CCS spectrum with the given DFT size
+// output is same size as a matchTemplate result
+// the padded image, its spectrum, and the correlation use the given buffers
+// image may be a region of a bigger image (padding never uses the pixels around it)
+static void correlate_dft(
+    const cv::Mat& rimg,
+    const cv::Mat& rtmpl_spectrum,
+    const cv::Size& rdft_size,
+    const cv::Size& rresult_size,
+    cv::Mat& rdst,
+    cv::Mat& rimg_pad,
+    cv::Mat& rimg_spectrum,
+    cv::Mat& rcorr)
+{
+    cv::copyMakeBorder(rimg, rimg_pad,
+        0, rdft_size.height - rimg.rows,
+        0, rdft_size.width - rimg.cols,
+        cv::BORDER_CONSTANT | cv::BORDER_ISOLATED, cv::Scalar::all(0));
+    cv::dft(rimg_pad, rimg_spectrum, 0, rimg.rows);
+    cv::mulSpectrums(rimg_spectrum, rtmpl_spectrum, rimg_spectrum, 0, true);
+    cv::dft(rimg_spectrum, rcorr, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, rresult_size.height);
+    rcorr(cv::Rect({ 0, 0 }, rresult_size)).copyTo(rdst);
+}
+
+
+// correlates a real image with a template using a cached template spectrum
+static void correlate_dft(
+    const cv::Mat& rimg,
+    const cv::Mat& rtmpl_spectrum,
+    const cv::Size& rdft_size,
+    const cv::Size& rresult_size,
+    cv::Mat& rdst)
+{
+    cv::Mat img_pad;
+    cv::Mat img_spectrum;
+    cv::Mat corr;
+    correlate_dft(rimg, rtmpl_spectrum, rdft_size, rresult_size, rdst, img_pad, img_spectrum, corr);
+}
+
+
+// makes conjugate-ready CCS spectrum of a template zero-padded to the DFT size
+// template may be a region of a bigger image (padding never uses the pixels around it)
+static void create_tmpl_spectrum(
+    const cv::Mat& rtmpl,
+    const cv::Size& rdft_size,
+    cv::Mat& rpad,
+    cv::Mat& rdst)
+{
+    cv::copyMakeBorder(rtmpl, rpad,
+        0, rdft_size.height - rtmpl.rows,
+        0, rdft_size.width - rtmpl.cols,
+        cv::BORDER_CONSTANT | cv::BORDER_ISOLATED, cv::Scalar::all(0));
+    cv::dft(rpad, rdst, 0, rtmpl.rows);
+}
+
+
+// returns true if two matrices have the same size, type, and data
+static bool is_same_data(const cv::Mat& ra, const cv::Mat& rb)
+{
+    if ((ra.size() != rb.size()) || (ra.type() != rb.type()))
+    {
+        return false;
+    }
+    const size_t nbytes = ra.cols * ra.elemSize();
+    for (int j = 0; j < ra.rows; j++)
+    {
+        if (std::memcmp(ra.ptr(j), rb.ptr(j), nbytes) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// returns orientation bin 0-7 for a gradient
+// the full 360 degrees are used so polarity of the edge is kept
+static inline int quant_orientation(const float dx, const float dy)
+{
+    return static_cast<int>((cv::fastAtan2(dy, dx) / 45.0f) + 0.5f) & 7;
+}
+
+
+// creates CV_8U image with one bit set for the orientation of each strong gradient
+static void quantize_orientations(
+    const cv::Mat& rgrad_x,
+    const cv::Mat& rgrad_y,
+    const double mag_min,
+    cv::Mat& rdst)
+{
+    const float mag2_min = static_cast<float>(mag_min * mag_min);
+    rdst.create(rgrad_x.size(), CV_8UC1);
+    for (int j = 0; j < rgrad_x.rows; j++)
+    {
+        const float * pgx = rgrad_x.ptr<float>(j);
+        const float * pgy = rgrad_y.ptr<float>(j);
+        uchar * pdst = rdst.ptr<uchar>(j);
+        for (int i = 0; i < rgrad_x.cols; i++)
+        {
+            const float mag2 = (pgx[i] * pgx[i]) + (pgy[i] * pgy[i]);
+            pdst[i] = (mag2 > mag2_min) ? static_cast<uchar>(1U << quant_orientation(pgx[i], pgy[i])) : 0U;
+        }
+    }
+}
+
+
+// ORs the orientation bits of each pixel with those of its neighbors
+static void spread_orientations(const cv::Mat& rsrc, const int r, cv::Mat& rdst)
+{
+    cv::Mat pad;
+    cv::copyMakeBorder(rsrc, pad, r, r, r, r, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    rdst = cv::Mat::zeros(rsrc.size(), CV_8UC1);
+    for (int j = 0; j <= 2 * r; j++)
+    {
+        for (int i = 0; i <= 2 * r; i++)
+        {
+            cv::bitwise_or(rdst, pad(cv::Rect({ i, j }, rsrc.size())), rdst);
+        }
+    }
+}
+
+
+// creates lookup tables that map spread orientation bits to a score for each orientation
+// same orientation scores 4 and an adjacent orientation scores 1
+static std::vector<cv::Mat> create_quant_response_luts(void)
+{
+    std::vector<cv::Mat> rvlut(8);
+    for (int k = 0; k < 8; k++)
+    {
+        const uchar same_bit = static_cast<uchar>(1U << k);
+        const uchar next_bits = static_cast<uchar>((1U << ((k + 1) & 7)) | (1U << ((k + 7) & 7)));
+        rvlut[k].create(1, 256, CV_8UC1);
+        uchar * plut = rvlut[k].ptr<uchar>(0);
+        for (int v = 0; v < 256; v++)
+        {
+            plut[v] = (v & same_bit) ? 4U : ((v & next_bits) ? 1U : 0U);
+        }
+    }
+    return rvlut;
+}
+
+
 TOGMatcher::TOGMatcher() :
-    tmpl_offset({ 0,0 })
+    tmpl_offset({ 0,0 }),
+    dft_img_size({ 0,0 }),
+    is_dft_mask_enabled(false),
+    mask_norm2_dx(0.0),
+    mask_norm2_dy(0.0),
+    norm2_dx(0.0),
+    norm2_dy(0.0),
+    is_mask_rect(false),
+    dft_norm2_dx(0.0),
+    dft_norm2_dy(0.0),
+    dft_cplx_img_size({ 0,0 }),
+    is_dft_cplx_mask_enabled(false),
+    dft_cplx_norm2(0.0),
+    sparse_max_pts(0U),
+    quant_mag_max(0.0),
+    grad_depth(TEMPLATE_DEPTH),
+    lowrank_energy(TOG_DEFAULT_LOWRANK_ENERGY),
+    lowrank_max(TOG_DEFAULT_LOWRANK_MAX),
+    is_lowrank_enabled(false),
+    calib_img_size({ 0,0 }),
+    is_calib_mask_enabled(false),
+    calib_ksize(TOG_DEFAULT_KSIZE),
+    calib_engine(engine_t::SPATIAL),
+    pyr_levels(TOG_DEFAULT_PYR_LEVELS),
+    pyr_topk(TOG_DEFAULT_PYR_TOPK)
 {
 }
 
@@ -51,7 +543,88 @@ void TOGMatcher::create_template_from_img(const cv::Mat& rsrc, const int ksize,
 }
 
 
+void TOGMatcher::create_template_from_gradients(
+    const cv::Mat& rgrad_x,
+    const cv::Mat& rgrad_y,
+    const double mag_thr)
+{
+    create_templates_from_gradients(rgrad_x, rgrad_y, mag_thr);
+    create_pyramid_from_gradients(tmpl_dx, tmpl_dy, mag_thr);
+}
+
+
+void TOGMatcher::create_template_from_compiled(
+    const cv::Mat& rdx,
+    const cv::Mat& rdy,
+    const cv::Mat& rmask,
+    const std::vector<std::vector<cv::Point>>& rcontours,
+    const cv::Point& roffset,
+    const double mag_thr)
+{
+    // data may belong to someone else (like a memory-mapped file) so copy it
+    tmpl_dx = rdx.clone();
+    tmpl_dy = rdy.clone();
+    tmpl_mask_32F = rmask.clone();
+    src_contours = rcontours;
+    tmpl_offset = roffset;
+
+    update_template_data();
+    create_pyramid_from_gradients(tmpl_dx, tmpl_dy, mag_thr);
+}
+
+
+void TOGMatcher::create_pyramid_from_gradients(
+    const cv::Mat& rgrad_x,
+    const cv::Mat& rgrad_y,
+    const double mag_thr)
+{
+    // create reduced-resolution templates for pyramid search
+    // each level is made from blurred and downsampled copies of the gradients
+    cv::Mat pyr_src_x = rgrad_x;
+    cv::Mat pyr_src_y = rgrad_y;
+    vpyr.clear();
+    for (int i = 0; i < pyr_levels; i++)
+    {
+        cv::Mat pyr_dst_x;
+        cv::Mat pyr_dst_y;
+        // stop if next level would be too small (pyrDown rounds up)
+        if ((((pyr_src_x.cols + 1) / 2) < TOG_PYR_MIN_SIZE) || (((pyr_src_x.rows + 1) / 2) < TOG_PYR_MIN_SIZE))
+        {
+            break;
+        }
+        cv::pyrDown(pyr_src_x, pyr_dst_x);
+        cv::pyrDown(pyr_src_y, pyr_dst_y);
+        vpyr.push_back(TOGMatcher());
+        vpyr.back().set_pyramid_params(0, pyr_topk);
+        vpyr.back().create_templates_from_gradients(pyr_dst_x, pyr_dst_y, mag_thr);
+        pyr_src_x = pyr_dst_x;
+        pyr_src_y = pyr_dst_y;
+    }
+}
+
+
 void TOGMatcher::create_templates(const cv::Mat& rsrc, const int ksize, const double mag_thr)
+{
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+
+    // calculate X and Y gradients
+    // they will become the gradient template images
+    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+    create_templates_from_gradients(grad_x, grad_y, mag_thr);
+
+    // create reduced-resolution templates for pyramid search
+    // they are made from the cropped template gradients (not the source image)
+    // so a template loaded from a library (see TOGLibrary) gets the same pyramid
+    create_pyramid_from_gradients(tmpl_dx, tmpl_dy, mag_thr);
+}
+
+
+void TOGMatcher::create_templates_from_gradients(
+    const cv::Mat& rgrad_x,
+    const cv::Mat& rgrad_y,
+    const double mag_thr)
 {
     double qmax;
     cv::Mat temp_m;
@@ -59,10 +632,8 @@ void TOGMatcher::create_templates(const cv::Mat& rsrc, const int ksize, const do
     cv::Mat temp_mask;
     std::vector<cv::Point> all_pts;
 
-    // calculate X and Y gradients
-    // they will become the gradient template images
-    Sobel(rsrc, tmpl_dx, TEMPLATE_DEPTH, 1, 0, ksize);
-    Sobel(rsrc, tmpl_dy, TEMPLATE_DEPTH, 0, 1, ksize);
+    tmpl_dx = rgrad_x.clone();
+    tmpl_dy = rgrad_y.clone();
 
     // create gradient magnitude mask
     // everything above the threshold (a fraction of the max) will be considered valid
@@ -99,71 +670,1831 @@ void TOGMatcher::create_templates(const cv::Mat& rsrc, const int ksize, const do
     tmpl_offset = temp_mask.size();
     tmpl_offset.x /= 2;
     tmpl_offset.y /= 2;
+
+    update_template_data();
 }
 
 
-void TOGMatcher::perform_match(
-    const cv::Mat& rsrc,
-    cv::Mat& rtmatch,
-    const bool is_mask_enabled,
-    const int ksize)
+void TOGMatcher::update_template_data(void)
 {
-    cv::Mat grad_x;
-    cv::Mat grad_y;
-    cv::Mat tmatch_x;
-    cv::Mat tmatch_y;
+    // masked templates and their norms are needed for every masked match
+    // so calculate them just once
+    tmpl_dx_masked = tmpl_dx.mul(tmpl_mask_32F);
+    tmpl_dy_masked = tmpl_dy.mul(tmpl_mask_32F);
+    mask_norm2_dx = cv::norm(tmpl_dx_masked, cv::NORM_L2SQR);
+    mask_norm2_dy = cv::norm(tmpl_dy_masked, cv::NORM_L2SQR);
+    norm2_dx = cv::norm(tmpl_dx, cv::NORM_L2SQR);
+    norm2_dy = cv::norm(tmpl_dy, cv::NORM_L2SQR);
+    is_mask_rect = (cv::countNonZero(tmpl_mask_32F) == static_cast<int>(tmpl_mask_32F.total()));
 
-    // calculate X and Y gradient images
-    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
-    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+    // any cached DFT data is now stale
+    dft_img_size = { 0,0 };
+    dft_cplx_img_size = { 0,0 };
 
-    // perform match with dX and dY magnitude templates
-    // it is up to the user whether or not the mask is enabled
-    if (is_mask_enabled)
+    // engines must be timed again with the new template
+    calib_img_size = { 0,0 };
+
+    compile_sparse_points();
+    compile_int16_points();
+    compile_quant_features();
+    compile_lowrank_templates();
+}
+
+
+void TOGMatcher::set_sparse_max_points(const size_t n)
+{
+    sparse_max_pts = n;
+    compile_sparse_points();
+
+    // sparse engine may no longer be exact so engines must be timed again
+    calib_img_size = { 0,0 };
+}
+
+
+void TOGMatcher::compile_sparse_points(void)
+{
+    vsparse_masked.clear();
+    vsparse_all.clear();
+
+    // collect masked pixels and all non-zero pixels
+    // masked pixels have the mask applied to the template values and energy weight
+    for (int j = 0; j < tmpl_dx.rows; j++)
     {
-        matchTemplate(grad_x, tmpl_dx, tmatch_x, cv::TM_CCORR_NORMED, tmpl_mask_32F);
-        matchTemplate(grad_y, tmpl_dy, tmatch_y, cv::TM_CCORR_NORMED, tmpl_mask_32F);
+        const float * pdx = tmpl_dx.ptr<float>(j);
+        const float * pdy = tmpl_dy.ptr<float>(j);
+        const float * pm = tmpl_mask_32F.ptr<float>(j);
+        for (int i = 0; i < tmpl_dx.cols; i++)
+        {
+            if (pm[i] != 0.0f)
+            {
+                vsparse_masked.push_back({ { i, j }, pdx[i] * pm[i], pdy[i] * pm[i], pm[i] * pm[i] });
+            }
+            if ((pdx[i] != 0.0f) || (pdy[i] != 0.0f))
+            {
+                vsparse_all.push_back({ { i, j }, pdx[i], pdy[i], 1.0f });
+            }
+        }
     }
-    else
+
+    // apply limit by keeping pixels with strongest gradients
+    // then restore row-major order so image rows are accessed sequentially
+    if (sparse_max_pts > 0)
     {
-        matchTemplate(grad_x, tmpl_dx, tmatch_x, cv::TM_CCORR_NORMED);
-        matchTemplate(grad_y, tmpl_dy, tmatch_y, cv::TM_CCORR_NORMED);
+        for (auto * pv : { &vsparse_masked, &vsparse_all })
+        {
+            if (pv->size() > sparse_max_pts)
+            {
+                std::sort(pv->begin(), pv->end(), [](const sparse_pt_t& a, const sparse_pt_t& b)
+                {
+                    return ((a.dx * a.dx) + (a.dy * a.dy)) > ((b.dx * b.dx) + (b.dy * b.dy));
+                });
+                pv->resize(sparse_max_pts);
+                std::sort(pv->begin(), pv->end(), [](const sparse_pt_t& a, const sparse_pt_t& b)
+                {
+                    return (a.pt.y < b.pt.y) || ((a.pt.y == b.pt.y) && (a.pt.x < b.pt.x));
+                });
+            }
+        }
     }
+}
 
-    // combine results by multiplying both matches together
-    rtmatch = tmatch_x.mul(tmatch_y);
+
+void TOGMatcher::compile_int16_points(void)
+{
+    vint16_masked.clear();
+    vint16_all.clear();
+    int16_abs_sum_masked[0] = 0.0;
+    int16_abs_sum_masked[1] = 0.0;
+    int16_abs_sum_all[0] = 0.0;
+    int16_abs_sum_all[1] = 0.0;
+
+    // same pixels as the uncapped sparse lists but rounded to integers
+    for (int j = 0; j < tmpl_dx.rows; j++)
+    {
+        const float * pdx = tmpl_dx.ptr<float>(j);
+        const float * pdy = tmpl_dy.ptr<float>(j);
+        const float * pm = tmpl_mask_32F.ptr<float>(j);
+        for (int i = 0; i < tmpl_dx.cols; i++)
+        {
+            const short dx = cv::saturate_cast<short>(pdx[i]);
+            const short dy = cv::saturate_cast<short>(pdy[i]);
+            if (pm[i] != 0.0f)
+            {
+                vint16_masked.push_back({ { i, j }, dx, dy });
+                int16_abs_sum_masked[0] += std::abs(dx);
+                int16_abs_sum_masked[1] += std::abs(dy);
+            }
+            if ((dx != 0) || (dy != 0))
+            {
+                vint16_all.push_back({ { i, j }, dx, dy });
+                int16_abs_sum_all[0] += std::abs(dx);
+                int16_abs_sum_all[1] += std::abs(dy);
+            }
+        }
+    }
 }
 
 
-void TOGMatcher::perform_match_sqdiff(
-    const cv::Mat& rsrc,
-    cv::Mat& rtmatch,
-    const bool is_mask_enabled,
-    const int ksize)
+void TOGMatcher::compile_quant_features(void)
 {
-    cv::Mat grad_x;
-    cv::Mat grad_y;
-    cv::Mat tmatch_x;
-    cv::Mat tmatch_y;
+    std::vector<std::pair<float, quant_feature_t>> vfeat;
+    float mag2_max = 0.0f;
 
-    // calculate X and Y gradient images
-    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
-    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+    // every pixel in magnitude mask becomes a feature
+    // and max magnitude sets the scale of the image magnitude threshold
+    for (int j = 0; j < tmpl_dx.rows; j++)
+    {
+        const float * pdx = tmpl_dx.ptr<float>(j);
+        const float * pdy = tmpl_dy.ptr<float>(j);
+        const float * pm = tmpl_mask_32F.ptr<float>(j);
+        for (int i = 0; i < tmpl_dx.cols; i++)
+        {
+            const float mag2 = (pdx[i] * pdx[i]) + (pdy[i] * pdy[i]);
+            mag2_max = std::max(mag2_max, mag2);
+            if ((pm[i] != 0.0f) && ((pdx[i] != 0.0f) || (pdy[i] != 0.0f)))
+            {
+                vfeat.push_back({ mag2, { { i, j }, quant_orientation(pdx[i], pdy[i]) } });
+            }
+        }
+    }
+    quant_mag_max = std::sqrt(static_cast<double>(mag2_max));
 
-    // perform match with dX and dY magnitude templates
-    // it is up to the user whether or not the mask is enabled
-    if (is_mask_enabled)
+    // keep only the strongest features if there are too many
+    // then restore row-major order
+    if (vfeat.size() > TOG_QUANT_MAX_FEATURES)
     {
-        matchTemplate(grad_x, tmpl_dx, tmatch_x, cv::TM_SQDIFF, tmpl_mask_32F);
-        matchTemplate(grad_y, tmpl_dy, tmatch_y, cv::TM_SQDIFF, tmpl_mask_32F);
+        std::sort(vfeat.begin(), vfeat.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        vfeat.resize(TOG_QUANT_MAX_FEATURES);
+        std::sort(vfeat.begin(), vfeat.end(), [](const auto& a, const auto& b)
+        {
+            return (a.second.pt.y < b.second.pt.y) ||
+                ((a.second.pt.y == b.second.pt.y) && (a.second.pt.x < b.second.pt.x));
+        });
     }
-    else
+
+    vquant.clear();
+    for (const auto& r : vfeat)
     {
-        matchTemplate(grad_x, tmpl_dx, tmatch_x, cv::TM_SQDIFF);
-        matchTemplate(grad_y, tmpl_dy, tmatch_y, cv::TM_SQDIFF);
+        vquant.push_back(r.second);
     }
+}
 
-    // combine results by adding match results
-    // best results for SQDIFF are minimums so do a sign flip
-    rtmatch = -(tmatch_x + tmatch_y);
+
+void TOGMatcher::set_lowrank_params(const double energy, const int max_rank)
+{
+    lowrank_energy = energy;
+    lowrank_max = (max_rank < 1) ? 1 : max_rank;
+    is_lowrank_enabled = true;
+    compile_lowrank_templates();
+}
+
+
+void TOGMatcher::compile_lowrank_templates(void)
+{
+    // SVDs are only done if low-rank matching has been enabled
+    if (is_lowrank_enabled && !tmpl_dx.empty())
+    {
+        factor_lowrank(tmpl_dx, lowrank_energy, lowrank_max, lowrank_all[0]);
+        factor_lowrank(tmpl_dy, lowrank_energy, lowrank_max, lowrank_all[1]);
+        factor_lowrank(tmpl_dx_masked, lowrank_energy, lowrank_max, lowrank_masked[0]);
+        factor_lowrank(tmpl_dy_masked, lowrank_energy, lowrank_max, lowrank_masked[1]);
+    }
+}
+
+
+double TOGMatcher::get_lowrank_speedup(const bool is_mask_enabled) const
+{
+    // full correlation has one tap for each template pixel
+    // each separable component has one tap for each row and column
+    const lowrank_tmpl_t * plowrank = (is_mask_enabled) ? lowrank_masked : lowrank_all;
+    const double full_taps = 2.0 * tmpl_dx.rows * tmpl_dx.cols;
+    const double sep_taps = static_cast<double>(
+        (plowrank[0].vcol.size() + plowrank[1].vcol.size()) * (tmpl_dx.rows + tmpl_dx.cols));
+    return (sep_taps > 0.0) ? (full_taps / sep_taps) : 0.0;
+}
+
+
+void TOGMatcher::find_peaks(
+    const cv::Mat& rtmatch,
+    const int k,
+    const double thr,
+    const cv::Size& rnms_size,
+    std::vector<peak_info_t>& rvpeaks)
+{
+    const int nms_x = rnms_size.width / 2;
+    const int nms_y = rnms_size.height / 2;
+    const int nrows = rtmatch.rows;
+    const int ncols = rtmatch.cols;
+    std::vector<peak_info_t> vheap;
+
+    rvpeaks.clear();
+    if (k <= 0)
+    {
+        ///////
+        return;
+        ///////
+    }
+
+    // greedy NMS only looks at local maxima until it has k peaks
+    // each of those is a peak or is within the window of a peak
+    // and local maxima can't be adjacent so this many always holds all of them
+    const size_t nheap = static_cast<size_t>(k) * (nms_x + 1) * (nms_y + 1);
+
+    // a peak ranks before another if it has a higher score or same score and is earlier in raster order
+    // heap is ordered so the worst ranked peak is at the front
+    auto is_better = [](const peak_info_t& a, const peak_info_t& b)
+    {
+        return (a.score > b.score) ||
+            ((a.score == b.score) && ((a.pt.y < b.pt.y) || ((a.pt.y == b.pt.y) && (a.pt.x < b.pt.x))));
+    };
+
+    for (int y = 0; y < nrows; y++)
+    {
+        const float * p0 = rtmatch.ptr<float>((y > 0) ? y - 1 : y);
+        const float * p1 = rtmatch.ptr<float>(y);
+        const float * p2 = rtmatch.ptr<float>((y < nrows - 1) ? y + 1 : y);
+        for (int x = 0; x < ncols; x++)
+        {
+            // skip anything below the threshold or the worst peak in a full heap
+            // (a later peak with the same score ranks after it)
+            // also skip values that are not valid normalized results (NaN or Inf)
+            const float q = p1[x];
+            const bool is_full = (vheap.size() == nheap);
+            if (!((q >= thr) && (q <= 1.01f) && (q > 0.0f)) || (is_full && (q <= vheap.front().score)))
+            {
+                continue;
+            }
+
+            // must be a local max in 3x3 neighborhood
+            // earlier pixels in raster order must be lower and later pixels must not be higher
+            // so a plateau only gives one peak
+            bool is_max = true;
+            for (int dy = -1; is_max && (dy <= 1); dy++)
+            {
+                const int yy = y + dy;
+                if ((yy < 0) || (yy >= nrows))
+                {
+                    continue;
+                }
+                const float * pn = rtmatch.ptr<float>(yy);
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    const int xx = x + dx;
+                    if (((dx == 0) && (dy == 0)) || (xx < 0) || (xx >= ncols))
+                    {
+                        continue;
+                    }
+                    const bool is_earlier = (dy < 0) || ((dy == 0) && (dx < 0));
+                    if ((is_earlier) ? (pn[xx] >= q) : (pn[xx] > q))
+                    {
+                        is_max = false;
+                        break;
+                    }
+                }
+            }
+            if (!is_max)
+            {
+                continue;
+            }
+
+            // fit parabola through peak and its neighbors in each direction
+            // neighbors outside the match result give no offset
+            peak_info_t peak = { { x, y }, q, { static_cast<float>(x), static_cast<float>(y) } };
+            if ((x > 0) && (x < ncols - 1))
+            {
+                const float d2 = p1[x - 1] - (2.0f * q) + p1[x + 1];
+                if (d2 < 0.0f)
+                {
+                    peak.ptsub.x += std::min(0.5f, std::max(-0.5f, 0.5f * (p1[x - 1] - p1[x + 1]) / d2));
+                }
+            }
+            if ((y > 0) && (y < nrows - 1))
+            {
+                const float d2 = p0[x] - (2.0f * q) + p2[x];
+                if (d2 < 0.0f)
+                {
+                    peak.ptsub.y += std::min(0.5f, std::max(-0.5f, 0.5f * (p0[x] - p2[x]) / d2));
+                }
+            }
+
+            // suppression is deferred so every local max goes in the heap
+            // and the worst one is dropped if there are too many
+            if (is_full)
+            {
+                std::pop_heap(vheap.begin(), vheap.end(), is_better);
+                vheap.pop_back();
+            }
+            vheap.push_back(peak);
+            std::push_heap(vheap.begin(), vheap.end(), is_better);
+        }
+    }
+
+    // greedy NMS on the heap from best to worst
+    std::sort_heap(vheap.begin(), vheap.end(), is_better);
+    for (const auto& rc : vheap)
+    {
+        if (static_cast<int>(rvpeaks.size()) == k)
+        {
+            break;
+        }
+
+        bool is_suppressed = false;
+        for (const auto& rp : rvpeaks)
+        {
+            if ((std::abs(rp.pt.x - rc.pt.x) <= nms_x) && (std::abs(rp.pt.y - rc.pt.y) <= nms_y))
+            {
+                is_suppressed = true;
+                break;
+            }
+        }
+        if (!is_suppressed)
+        {
+            rvpeaks.push_back(rc);
+        }
+    }
+}
+
+
+void TOGMatcher::find_match_peaks(
+    const cv::Mat& rtmatch,
+    const int k,
+    const double thr,
+    std::vector<peak_info_t>& rvpeaks) const
+{
+    find_peaks(rtmatch, k, thr, tmpl_dx.size(), rvpeaks);
+}
+
+
+void TOGMatcher::set_pyramid_params(const int levels, const int topk)
+{
+    pyr_levels = (levels < 0) ? 0 : levels;
+    pyr_topk = (topk < 1) ? 1 : topk;
+}
+
+
+void TOGMatcher::update_dft_cache(const cv::Size& rimg_size, const bool is_mask_enabled)
+{
+    if ((rimg_size != dft_img_size) || (is_mask_enabled != is_dft_mask_enabled))
+    {
+        cv::Mat tdx = tmpl_dx;
+        cv::Mat tdy = tmpl_dy;
+        cv::Mat tpad;
+
+        dft_img_size = rimg_size;
+        is_dft_mask_enabled = is_mask_enabled;
+
+        // DFT must be big enough to hold entire image so there is no wrap-around
+        dft_size.width = cv::getOptimalDFTSize(rimg_size.width);
+        dft_size.height = cv::getOptimalDFTSize(rimg_size.height);
+
+        // masked correlation is the same as unmasked correlation with a masked template
+        if (is_mask_enabled)
+        {
+            tdx = tmpl_dx.mul(tmpl_mask_32F);
+            tdy = tmpl_dy.mul(tmpl_mask_32F);
+            cv::copyMakeBorder(tmpl_mask_32F, tpad,
+                0, dft_size.height - tmpl_mask_32F.rows,
+                0, dft_size.width - tmpl_mask_32F.cols,
+                cv::BORDER_CONSTANT, cv::Scalar::all(0));
+            cv::dft(tpad, dft_tmpl_mask, cv::DFT_COMPLEX_OUTPUT, tmpl_mask_32F.rows);
+        }
+
+        // unmasked template is a region of the uncropped gradients
+        // so padding must not pick up the gradients around it
+        cv::copyMakeBorder(tdx, tpad,
+            0, dft_size.height - tdx.rows,
+            0, dft_size.width - tdx.cols,
+            cv::BORDER_CONSTANT | cv::BORDER_ISOLATED, cv::Scalar::all(0));
+        cv::dft(tpad, dft_tmpl_dx, 0, tdx.rows);
+
+        cv::copyMakeBorder(tdy, tpad,
+            0, dft_size.height - tdy.rows,
+            0, dft_size.width - tdy.cols,
+            cv::BORDER_CONSTANT | cv::BORDER_ISOLATED, cv::Scalar::all(0));
+        cv::dft(tpad, dft_tmpl_dy, 0, tdy.rows);
+
+        dft_norm2_dx = cv::norm(tdx, cv::NORM_L2SQR);
+        dft_norm2_dy = cv::norm(tdy, cv::NORM_L2SQR);
+    }
+}
+
+
+void TOGMatcher::update_dft_complex_cache(const cv::Size& rimg_size, const bool is_mask_enabled)
+{
+    if ((rimg_size != dft_cplx_img_size) || (is_mask_enabled != is_dft_cplx_mask_enabled))
+    {
+        cv::Mat tparts[2];
+        cv::Mat tpad;
+
+        dft_cplx_img_size = rimg_size;
+        is_dft_cplx_mask_enabled = is_mask_enabled;
+
+        // DFT must be big enough to hold entire image so there is no wrap-around
+        dft_cplx_size.width = cv::getOptimalDFTSize(rimg_size.width);
+        dft_cplx_size.height = cv::getOptimalDFTSize(rimg_size.height);
+
+        // masked correlation is the same as unmasked correlation with a masked template
+        tparts[0] = (is_mask_enabled) ? tmpl_dx_masked : tmpl_dx;
+        tparts[1] = (is_mask_enabled) ? tmpl_dy_masked : tmpl_dy;
+        cv::merge(tparts, 2, tpad);
+        cv::copyMakeBorder(tpad, tpad,
+            0, dft_cplx_size.height - tpad.rows,
+            0, dft_cplx_size.width - tpad.cols,
+            cv::BORDER_CONSTANT, cv::Scalar::all(0));
+        cv::dft(tpad, dft_tmpl_cplx, 0, tparts[0].rows);
+
+        dft_cplx_norm2 = (is_mask_enabled) ? (mask_norm2_dx + mask_norm2_dy) : (norm2_dx + norm2_dy);
+    }
+}
+
+
+void TOGMatcher::perform_match(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize) const
+{
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+
+    if ((grad_depth == CV_16S) && is_int16_match_ok(rsrc, ksize, is_mask_enabled))
+    {
+        perform_match_int16(rsrc, rtmatch, is_mask_enabled, ksize);
+        ///////
+        return;
+        ///////
+    }
+
+    // calculate X and Y gradient images
+    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+
+    perform_match_grad(grad_x, grad_y, rtmatch, is_mask_enabled);
+}
+
+
+bool TOGMatcher::is_int16_match_ok(const cv::Mat& rsrc, const int ksize, const bool is_mask_enabled) const
+{
+    // largest correlation magnitude is max gradient times sum of absolute template values
+    // largest masked energy is max gradient squared times number of mask pixels
+    // unmasked energy is calculated in double precision so it has no limit
+    const double gmax = max_int16_gradient(ksize);
+    const double * pabs_sum = (is_mask_enabled) ? int16_abs_sum_masked : int16_abs_sum_all;
+    const double energy_max = (is_mask_enabled) ? (gmax * gmax * vint16_masked.size()) : 0.0;
+
+    // spatial correlation only beats the DFT for templates with few points
+    const size_t npts = (is_mask_enabled) ? vint16_masked.size() : vint16_all.size();
+    return
+        (npts <= TOG_INT16_MAX_POINTS) &&
+        (rsrc.depth() == CV_8U) &&
+        (gmax > 0.0) &&
+        ((gmax * std::max(pabs_sum[0], pabs_sum[1])) < INT_MAX) &&
+        (energy_max < INT_MAX);
+}
+
+
+void TOGMatcher::perform_match_int16(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize) const
+{
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+    cv::Mat energy_x;
+    cv::Mat energy_y;
+
+    const std::vector<int16_pt_t>& rvpts = (is_mask_enabled) ? vint16_masked : vint16_all;
+    const int ncols = rsrc.cols - tmpl_dx.cols + 1;
+    const int nrows = rsrc.rows - tmpl_dx.rows + 1;
+
+    // calculate X and Y gradient images with half the bandwidth of CV_32F
+    Sobel(rsrc, grad_x, CV_16S, 1, 0, ksize);
+    Sobel(rsrc, grad_y, CV_16S, 0, 1, ksize);
+
+    // unmasked energy is a box sum
+    if (!is_mask_enabled)
+    {
+        window_sum_sq(grad_x, tmpl_dx.size(), energy_x);
+        window_sum_sq(grad_y, tmpl_dy.size(), energy_y);
+    }
+
+    // template norms
+    double tnorm2_x = 0.0;
+    double tnorm2_y = 0.0;
+    for (const auto& r : rvpts)
+    {
+        tnorm2_x += r.dx * r.dx;
+        tnorm2_y += r.dy * r.dy;
+    }
+    const double tnorm_x = std::sqrt(tnorm2_x);
+    const double tnorm_y = std::sqrt(tnorm2_y);
+
+    // int32 row buffers for the accumulated sums
+    std::vector<int> vbuf(ncols * 4);
+    int * pnum_x = vbuf.data();
+    int * pnum_y = pnum_x + ncols;
+    int * pen_x = pnum_y + ncols;
+    int * pen_y = pen_x + ncols;
+
+    rtmatch.create(nrows, ncols, TEMPLATE_DEPTH);
+
+    for (int y = 0; y < nrows; y++)
+    {
+        std::fill(vbuf.begin(), vbuf.end(), 0);
+
+        // each template pixel adds a shifted and scaled image row to the sums
+        // mask is binary so each masked pixel adds a squared image row to the energies
+        for (const auto& r : rvpts)
+        {
+            const short * pgx = grad_x.ptr<short>(y + r.pt.y) + r.pt.x;
+            const short * pgy = grad_y.ptr<short>(y + r.pt.y) + r.pt.x;
+            if (r.dx != 0)
+            {
+                accumulate_scaled_row_16s(pnum_x, pgx, r.dx, ncols);
+            }
+            if (r.dy != 0)
+            {
+                accumulate_scaled_row_16s(pnum_y, pgy, r.dy, ncols);
+            }
+            if (is_mask_enabled)
+            {
+                accumulate_square_row_16s(pen_x, pgx, ncols);
+                accumulate_square_row_16s(pen_y, pgy, ncols);
+            }
+        }
+
+        // normalize as floats and combine results by multiplying both matches together
+        const float * pbox_x = (is_mask_enabled) ? nullptr : energy_x.ptr<float>(y);
+        const float * pbox_y = (is_mask_enabled) ? nullptr : energy_y.ptr<float>(y);
+        float * pdst = rtmatch.ptr<float>(y);
+        for (int i = 0; i < ncols; i++)
+        {
+            const double ex = (is_mask_enabled) ? pen_x[i] : pbox_x[i];
+            const double ey = (is_mask_enabled) ? pen_y[i] : pbox_y[i];
+            double qx = ccorr_normalize_value(pnum_x[i], ex, tnorm_x, 0.0);
+            double qy = ccorr_normalize_value(pnum_y[i], ey, tnorm_y, 0.0);
+            pdst[i] = static_cast<float>(qx * qy);
+        }
+    }
+}
+
+
+void TOGMatcher::perform_match_grad(
+    const cv::Mat& rgrad_x,
+    const cv::Mat& rgrad_y,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled) const
+{
+    cv::Mat tmatch_x;
+    cv::Mat tmatch_y;
+
+    // perform match with dX and dY magnitude templates
+    // it is up to the user whether or not the mask is enabled
+    if (is_mask_enabled)
+    {
+        matchTemplate(rgrad_x, tmpl_dx, tmatch_x, cv::TM_CCORR_NORMED, tmpl_mask_32F);
+        matchTemplate(rgrad_y, tmpl_dy, tmatch_y, cv::TM_CCORR_NORMED, tmpl_mask_32F);
+    }
+    else
+    {
+        matchTemplate(rgrad_x, tmpl_dx, tmatch_x, cv::TM_CCORR_NORMED);
+        matchTemplate(rgrad_y, tmpl_dy, tmatch_y, cv::TM_CCORR_NORMED);
+    }
+
+    // combine results by multiplying both matches together
+    rtmatch = tmatch_x.mul(tmatch_y);
+}
+
+
+void TOGMatcher::perform_match_dft(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize)
+{
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+    cv::Mat corr_x;
+    cv::Mat corr_y;
+    cv::Mat energy_x;
+    cv::Mat energy_y;
+    cv::Mat tmatch_x;
+    cv::Mat tmatch_y;
+    double energy_min_x = 0.0;
+    double energy_min_y = 0.0;
+
+    // calculate X and Y gradient images
+    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+
+    // template spectra only need to be calculated once for each image size
+    update_dft_cache(rsrc.size(), is_mask_enabled);
+    const cv::Size result_size(rsrc.cols - tmpl_dx.cols + 1, rsrc.rows - tmpl_dx.rows + 1);
+
+    // one forward and one inverse DFT for each gradient image
+    correlate_dft(grad_x, dft_tmpl_dx, dft_size, result_size, corr_x);
+    correlate_dft(grad_y, dft_tmpl_dy, dft_size, result_size, corr_y);
+
+    // determine image energy in each template window
+    if (is_mask_enabled)
+    {
+        // pack squared X and Y gradients into one complex image
+        // then correlate with the mask in one complex DFT round-trip
+        // X results are in the real part and Y results are in the imaginary part
+        cv::Mat grad_sq[2];
+        cv::Mat grad_sq_pad;
+        cv::Mat energy_xy;
+        cv::Mat energy_parts[2];
+        double energy_max_x;
+        double energy_max_y;
+        grad_sq[0] = grad_x.mul(grad_x);
+        grad_sq[1] = grad_y.mul(grad_y);
+        cv::merge(grad_sq, 2, grad_sq_pad);
+        cv::copyMakeBorder(grad_sq_pad, grad_sq_pad,
+            0, dft_size.height - rsrc.rows,
+            0, dft_size.width - rsrc.cols,
+            cv::BORDER_CONSTANT, cv::Scalar::all(0));
+        cv::dft(grad_sq_pad, energy_xy, 0, rsrc.rows);
+        cv::mulSpectrums(energy_xy, dft_tmpl_mask, energy_xy, 0, true);
+        cv::dft(energy_xy, energy_xy, cv::DFT_INVERSE | cv::DFT_SCALE, result_size.height);
+        cv::split(energy_xy(cv::Rect({ 0, 0 }, result_size)), energy_parts);
+        energy_x = energy_parts[0];
+        energy_y = energy_parts[1];
+
+        // DFT round-off can leave tiny non-zero energies in flat regions
+        // so treat anything at that level as zero energy
+        cv::minMaxLoc(energy_x, nullptr, &energy_max_x);
+        cv::minMaxLoc(energy_y, nullptr, &energy_max_y);
+        energy_min_x = energy_max_x * 1.0e-7;
+        energy_min_y = energy_max_y * 1.0e-7;
+    }
+    else
+    {
+        window_sum_sq(grad_x, tmpl_dx.size(), energy_x);
+        window_sum_sq(grad_y, tmpl_dy.size(), energy_y);
+    }
+
+    ccorr_normalize(corr_x, energy_x, dft_norm2_dx, tmatch_x, energy_min_x);
+    ccorr_normalize(corr_y, energy_y, dft_norm2_dy, tmatch_y, energy_min_y);
+
+    // combine results by multiplying both matches together
+    rtmatch = tmatch_x.mul(tmatch_y);
+}
+
+
+void TOGMatcher::perform_match_complex(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize)
+{
+    cv::Mat grad[2];
+    cv::Mat grad_xy;
+    cv::Mat grad_mag2;
+    cv::Mat corr_xy;
+    cv::Mat corr;
+    cv::Mat energy;
+    double energy_min = 0.0;
+
+    // calculate X and Y gradient images and pack them into one complex image
+    Sobel(rsrc, grad[0], TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad[1], TEMPLATE_DEPTH, 0, 1, ksize);
+    cv::merge(grad, 2, grad_xy);
+
+    // template spectrum only needs to be calculated once for each image size
+    update_dft_complex_cache(rsrc.size(), is_mask_enabled);
+    const cv::Size result_size(rsrc.cols - tmpl_dx.cols + 1, rsrc.rows - tmpl_dx.rows + 1);
+    const cv::Rect result_roi({ 0, 0 }, result_size);
+
+    // one forward and one inverse complex DFT for both gradients
+    // conjugate template gives dX*tX + dY*tY in real part (and cross product in imaginary part)
+    cv::copyMakeBorder(grad_xy, grad_xy,
+        0, dft_cplx_size.height - rsrc.rows,
+        0, dft_cplx_size.width - rsrc.cols,
+        cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    cv::dft(grad_xy, corr_xy, 0, rsrc.rows);
+    cv::mulSpectrums(corr_xy, dft_tmpl_cplx, corr_xy, 0, true);
+    cv::dft(corr_xy, corr_xy, cv::DFT_INVERSE | cv::DFT_SCALE, result_size.height);
+    cv::extractChannel(corr_xy(result_roi), corr, 0);
+
+    // image energy in each template window is sum of squared gradient magnitudes
+    if ((!is_mask_enabled) || is_mask_rect)
+    {
+        cv::Mat energy_y;
+        window_sum_sq(grad[0], tmpl_dx.size(), energy);
+        window_sum_sq(grad[1], tmpl_dy.size(), energy_y);
+        energy += energy_y;
+    }
+    else
+    {
+        // mask is binary so squared mask is the mask itself
+        double energy_max;
+        grad_mag2 = grad[0].mul(grad[0]) + grad[1].mul(grad[1]);
+        cv::filter2D(grad_mag2, energy, -1, tmpl_mask_32F, { 0, 0 }, 0.0, cv::BORDER_CONSTANT);
+        energy = energy(result_roi);
+
+        // big kernels are applied with a DFT which can leave tiny non-zero
+        // energies in flat regions so treat anything at that level as zero energy
+        cv::minMaxLoc(energy, nullptr, &energy_max);
+        energy_min = energy_max * 1.0e-7;
+    }
+
+    ccorr_normalize(corr, energy, dft_cplx_norm2, rtmatch, energy_min);
+}
+
+
+void TOGMatcher::perform_match_lowrank(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize) const
+{
+    cv::Mat grad[2];
+    cv::Mat corr[2];
+    cv::Mat energy[2];
+    cv::Mat tmatch[2];
+    cv::Mat filtered;
+    double energy_min[2] = { 0.0, 0.0 };
+
+    if (!is_lowrank_enabled)
+    {
+        // templates have not been factored
+        perform_match(rsrc, rtmatch, is_mask_enabled, ksize);
+        ///////
+        return;
+        ///////
+    }
+
+    const lowrank_tmpl_t * plowrank = (is_mask_enabled) ? lowrank_masked : lowrank_all;
+    const cv::Rect result_roi(0, 0, rsrc.cols - tmpl_dx.cols + 1, rsrc.rows - tmpl_dx.rows + 1);
+
+    // calculate X and Y gradient images
+    Sobel(rsrc, grad[0], TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad[1], TEMPLATE_DEPTH, 0, 1, ksize);
+
+    for (int n = 0; n < 2; n++)
+    {
+        // correlation is sum of separable correlations for each component
+        // anchor at upper-left makes each output the same as a matchTemplate result
+        corr[n] = cv::Mat::zeros(result_roi.size(), TEMPLATE_DEPTH);
+        for (size_t k = 0; k < plowrank[n].vcol.size(); k++)
+        {
+            cv::sepFilter2D(grad[n], filtered, TEMPLATE_DEPTH,
+                plowrank[n].vrow[k], plowrank[n].vcol[k], { 0, 0 }, 0.0, cv::BORDER_CONSTANT);
+            corr[n] += filtered(result_roi);
+        }
+
+        // determine image energy in each template window
+        if ((!is_mask_enabled) || is_mask_rect)
+        {
+            window_sum_sq(grad[n], tmpl_dx.size(), energy[n]);
+        }
+        else
+        {
+            // mask is binary so squared mask is the mask itself
+            double energy_max;
+            cv::filter2D(grad[n].mul(grad[n]), energy[n], -1, tmpl_mask_32F, { 0, 0 }, 0.0, cv::BORDER_CONSTANT);
+            energy[n] = energy[n](result_roi);
+
+            // big kernels are applied with a DFT which can leave tiny non-zero
+            // energies in flat regions so treat anything at that level as zero energy
+            cv::minMaxLoc(energy[n], nullptr, &energy_max);
+            energy_min[n] = energy_max * 1.0e-7;
+        }
+
+        // normalize with norm of approximation so results stay in range -1.0 to 1.0
+        ccorr_normalize(corr[n], energy[n], plowrank[n].norm2, tmatch[n], energy_min[n]);
+    }
+
+    // combine results by multiplying both matches together
+    rtmatch = tmatch[0].mul(tmatch[1]);
+}
+
+
+void TOGMatcher::perform_match_integral(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize) const
+{
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+
+    // calculate X and Y gradient images
+    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+
+    perform_match_grad_integral(grad_x, grad_y, rtmatch, is_mask_enabled);
+}
+
+
+void TOGMatcher::perform_match_grad_integral(
+    const cv::Mat& rgrad_x,
+    const cv::Mat& rgrad_y,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled) const
+{
+    cv::Mat corr_x;
+    cv::Mat corr_y;
+    cv::Mat energy_x;
+    cv::Mat energy_y;
+    cv::Mat tmatch_x;
+    cv::Mat tmatch_y;
+    double energy_min_x = 0.0;
+    double energy_min_y = 0.0;
+
+    // unmasked OpenCV match already gets window energies from integral images
+    if (!is_mask_enabled)
+    {
+        perform_match_grad(rgrad_x, rgrad_y, rtmatch, false);
+        ///////
+        return;
+        ///////
+    }
+
+    // plain correlation with the masked templates
+    matchTemplate(rgrad_x, tmpl_dx_masked, corr_x, cv::TM_CCORR);
+    matchTemplate(rgrad_y, tmpl_dy_masked, corr_y, cv::TM_CCORR);
+
+    if (is_mask_rect)
+    {
+        // every template pixel is used so energy is just a box sum
+        window_sum_sq(rgrad_x, tmpl_dx.size(), energy_x);
+        window_sum_sq(rgrad_y, tmpl_dy.size(), energy_y);
+    }
+    else
+    {
+        // mask is binary so squared mask is the mask itself
+        // pack squared X and Y gradients into one 2-channel image
+        // then correlate both channels with the mask in one pass
+        cv::Mat grad_sq[2];
+        cv::Mat grad_sq_xy;
+        cv::Mat energy_xy;
+        cv::Mat energy_parts[2];
+        double energy_max_x;
+        double energy_max_y;
+        const cv::Rect result_roi(0, 0, corr_x.cols, corr_x.rows);
+        grad_sq[0] = rgrad_x.mul(rgrad_x);
+        grad_sq[1] = rgrad_y.mul(rgrad_y);
+        cv::merge(grad_sq, 2, grad_sq_xy);
+        cv::filter2D(grad_sq_xy, energy_xy, -1, tmpl_mask_32F, { 0, 0 }, 0.0, cv::BORDER_CONSTANT);
+        cv::split(energy_xy(result_roi), energy_parts);
+        energy_x = energy_parts[0];
+        energy_y = energy_parts[1];
+
+        // big kernels are applied with a DFT which can leave tiny non-zero
+        // energies in flat regions so treat anything at that level as zero energy
+        cv::minMaxLoc(energy_x, nullptr, &energy_max_x);
+        cv::minMaxLoc(energy_y, nullptr, &energy_max_y);
+        energy_min_x = energy_max_x * 1.0e-7;
+        energy_min_y = energy_max_y * 1.0e-7;
+    }
+
+    ccorr_normalize(corr_x, energy_x, mask_norm2_dx, tmatch_x, energy_min_x);
+    ccorr_normalize(corr_y, energy_y, mask_norm2_dy, tmatch_y, energy_min_y);
+
+    // combine results by multiplying both matches together
+    rtmatch = tmatch_x.mul(tmatch_y);
+}
+
+
+void TOGMatcher::zero_invalid_results(cv::Mat& rtmatch)
+{
+    cv::patchNaNs(rtmatch, 0.0);
+    cv::threshold(rtmatch, rtmatch, 1.01, 0.0, cv::THRESH_TOZERO_INV);
+}
+
+
+void TOGMatcher::perform_match_pyramid(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize)
+{
+    std::vector<cv::Mat> vimg;
+    std::vector<peak_info_t> vpeaks;
+    int nlevels = static_cast<int>(vpyr.size());
+
+    // build image pyramid with same number of levels as template pyramid
+    // then skip any coarse levels where the image is smaller than the template
+    cv::buildPyramid(rsrc, vimg, nlevels);
+    while (nlevels > 0)
+    {
+        const cv::Mat& rtdx = vpyr[nlevels - 1].tmpl_dx;
+        if ((vimg[nlevels].cols >= rtdx.cols) && (vimg[nlevels].rows >= rtdx.rows))
+        {
+            break;
+        }
+        nlevels--;
+    }
+
+    if (nlevels == 0)
+    {
+        // no usable reduced-resolution levels so do full match
+        perform_match(rsrc, rtmatch, is_mask_enabled, ksize);
+        ///////
+        return;
+        ///////
+    }
+
+    // full search at coarsest level
+    // then suppress neighborhoods about the size of the template around each peak
+    // so the candidates are distinct
+    {
+        cv::Mat tmatch;
+        const TOGMatcher& rcoarse = vpyr[nlevels - 1];
+        rcoarse.perform_match(vimg[nlevels], tmatch, is_mask_enabled, ksize);
+        find_peaks(tmatch, pyr_topk, 0.0, rcoarse.tmpl_dx.size() / 2, vpeaks);
+    }
+
+    rtmatch = cv::Mat::zeros(
+        rsrc.rows - tmpl_dx.rows + 1,
+        rsrc.cols - tmpl_dx.cols + 1,
+        TEMPLATE_DEPTH);
+
+    // refine candidates at each finer level
+    for (int lev = nlevels - 1; lev >= 0; lev--)
+    {
+        const TOGMatcher& rcoarse = vpyr[lev];
+        const TOGMatcher& rfine = (lev == 0) ? *this : vpyr[lev - 1];
+        const cv::Mat& rimg = vimg[lev];
+        const cv::Rect rimg_rect({ 0, 0 }, rimg.size() - rfine.tmpl_dx.size() + cv::Size(1, 1));
+        const cv::Point ptr(TOG_PYR_SEARCH_RADIUS, TOG_PYR_SEARCH_RADIUS);
+        std::vector<peak_info_t> vrefined;
+
+        for (const auto& rpeak : vpeaks)
+        {
+            // center of coarse template maps to twice that location at finer level
+            // so search all template positions within a small radius of that point
+            cv::Point ptfine = ((rpeak.pt + rcoarse.tmpl_offset) * 2) - rfine.tmpl_offset;
+            cv::Rect rsearch = cv::Rect(ptfine - ptr, ptfine + ptr + cv::Point(1, 1)) & rimg_rect;
+            if (rsearch.area() > 0)
+            {
+                cv::Mat tmatch;
+                peak_info_t peak;
+                cv::Rect rroi(rsearch.tl(), rsearch.size() + rfine.tmpl_dx.size() - cv::Size(1, 1));
+                rfine.perform_match(rimg(rroi), tmatch, is_mask_enabled, ksize);
+                zero_invalid_results(tmatch);
+                cv::minMaxLoc(tmatch, nullptr, &peak.score, nullptr, &peak.pt);
+                peak.pt += rsearch.tl();
+                vrefined.push_back(peak);
+
+                // save full-resolution results
+                if (lev == 0)
+                {
+                    tmatch.copyTo(rtmatch(rsearch));
+                }
+            }
+        }
+
+        vpeaks = vrefined;
+    }
+}
+
+
+void TOGMatcher::perform_match_fused(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize) const
+{
+    // fused kernel only handles the central difference gradients of an 8-bit image
+    if ((ksize != 1) || (rsrc.type() != CV_8UC1))
+    {
+        perform_match(rsrc, rtmatch, is_mask_enabled, ksize);
+        ///////
+        return;
+        ///////
+    }
+
+    const int tcols = tmpl_dx.cols;
+    const int trows = tmpl_dx.rows;
+    const int ncols = rsrc.cols - tcols + 1;
+    const int nrows = rsrc.rows - trows + 1;
+
+    // masked correlation is the same as unmasked correlation with a masked template
+    cv::Mat tdx = tmpl_dx;
+    cv::Mat tdy = tmpl_dy;
+    if (is_mask_enabled)
+    {
+        tdx = tmpl_dx.mul(tmpl_mask_32F);
+        tdy = tmpl_dy.mul(tmpl_mask_32F);
+    }
+    const double tnorm_x = cv::norm(tdx);
+    const double tnorm_y = cv::norm(tdy);
+
+    // ring buffer with gradients for the template rows of the current window
+    // and row buffers for the accumulated sums
+    // everything is small enough to stay in cache
+    const int nring = rsrc.cols * 4;
+    std::vector<float> vbuf((nring * trows) + (ncols * 4));
+    float * pring = vbuf.data();
+    float * pnum_x = pring + (nring * trows);
+    float * pnum_y = pnum_x + ncols;
+    float * pen_x = pnum_y + ncols;
+    float * pen_y = pen_x + ncols;
+
+    rtmatch.create(nrows, ncols, TEMPLATE_DEPTH);
+
+    for (int y = 0; y < nrows; y++)
+    {
+        std::fill(pnum_x, pnum_x + (ncols * 4), 0.0f);
+
+        // gradients are calculated on the fly once for each image row
+        // and are never stored in a full gradient image
+        // first window needs all its rows then each window needs one new row
+        for (int r = (y == 0) ? 0 : (y + trows - 1); r < y + trows; r++)
+        {
+            float * pg = pring + (nring * (r % trows));
+            central_diff_row(rsrc, r, pg, pg + rsrc.cols, pg + (rsrc.cols * 2), pg + (rsrc.cols * 3));
+        }
+
+        for (int j = 0; j < trows; j++)
+        {
+            const float * pgx = pring + (nring * ((y + j) % trows));
+            const float * pgy = pgx + rsrc.cols;
+            const float * pgx2 = pgy + rsrc.cols;
+            const float * pgy2 = pgx2 + rsrc.cols;
+
+            const float * ptx = tdx.ptr<float>(j);
+            const float * pty = tdy.ptr<float>(j);
+            const float * pm = tmpl_mask_32F.ptr<float>(j);
+            for (int i = 0; i < tcols; i++)
+            {
+                // skip template pixels that contribute nothing
+                if (ptx[i] != 0.0f)
+                {
+                    accumulate_scaled_row(pnum_x, pgx + i, ptx[i], ncols);
+                }
+                if (pty[i] != 0.0f)
+                {
+                    accumulate_scaled_row(pnum_y, pgy + i, pty[i], ncols);
+                }
+                if (is_mask_enabled && (pm[i] != 0.0f))
+                {
+                    accumulate_scaled_row(pen_x, pgx2 + i, pm[i] * pm[i], ncols);
+                    accumulate_scaled_row(pen_y, pgy2 + i, pm[i] * pm[i], ncols);
+                }
+            }
+
+            // unmasked window energy is just a box sum of the squared gradients
+            if (!is_mask_enabled)
+            {
+                accumulate_box_row(pen_x, pgx2, tcols, ncols);
+                accumulate_box_row(pen_y, pgy2, tcols, ncols);
+            }
+        }
+
+        // normalize and combine results by multiplying both matches together
+        float * pdst = rtmatch.ptr<float>(y);
+        for (int i = 0; i < ncols; i++)
+        {
+            double qx = ccorr_normalize_value(pnum_x[i], pen_x[i], tnorm_x, 0.0);
+            double qy = ccorr_normalize_value(pnum_y[i], pen_y[i], tnorm_y, 0.0);
+            pdst[i] = static_cast<float>(qx * qy);
+        }
+    }
+}
+
+
+void TOGMatcher::perform_match_sparse(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize) const
+{
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+    cv::Mat grad_x2;
+    cv::Mat grad_y2;
+    cv::Mat energy_x;
+    cv::Mat energy_y;
+
+    const std::vector<sparse_pt_t>& rvpts = get_sparse_points(is_mask_enabled);
+    const int ncols = rsrc.cols - tmpl_dx.cols + 1;
+    const int nrows = rsrc.rows - tmpl_dx.rows + 1;
+
+    // energy of each image window comes from the template pixels
+    // unless it is an unmasked match with every non-zero template pixel
+    const bool is_box_energy = (!is_mask_enabled) && (sparse_max_pts == 0);
+
+    // calculate X and Y gradient images
+    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+
+    if (is_box_energy)
+    {
+        window_sum_sq(grad_x, tmpl_dx.size(), energy_x);
+        window_sum_sq(grad_y, tmpl_dy.size(), energy_y);
+    }
+    else
+    {
+        grad_x2 = grad_x.mul(grad_x);
+        grad_y2 = grad_y.mul(grad_y);
+    }
+
+    // template norms
+    double tnorm2_x = 0.0;
+    double tnorm2_y = 0.0;
+    for (const auto& r : rvpts)
+    {
+        tnorm2_x += r.dx * r.dx;
+        tnorm2_y += r.dy * r.dy;
+    }
+    const double tnorm_x = std::sqrt(tnorm2_x);
+    const double tnorm_y = std::sqrt(tnorm2_y);
+
+    // row buffers for the accumulated sums
+    std::vector<float> vbuf(ncols * 4);
+    float * pnum_x = vbuf.data();
+    float * pnum_y = pnum_x + ncols;
+    float * pen_x = pnum_y + ncols;
+    float * pen_y = pen_x + ncols;
+
+    rtmatch.create(nrows, ncols, TEMPLATE_DEPTH);
+
+    for (int y = 0; y < nrows; y++)
+    {
+        std::fill(vbuf.begin(), vbuf.end(), 0.0f);
+
+        // each template pixel adds a shifted and scaled image row to the sums
+        for (const auto& r : rvpts)
+        {
+            const int k = y + r.pt.y;
+            accumulate_scaled_row(pnum_x, grad_x.ptr<float>(k) + r.pt.x, r.dx, ncols);
+            accumulate_scaled_row(pnum_y, grad_y.ptr<float>(k) + r.pt.x, r.dy, ncols);
+            if (!is_box_energy)
+            {
+                accumulate_scaled_row(pen_x, grad_x2.ptr<float>(k) + r.pt.x, r.w, ncols);
+                accumulate_scaled_row(pen_y, grad_y2.ptr<float>(k) + r.pt.x, r.w, ncols);
+            }
+        }
+
+        if (is_box_energy)
+        {
+            std::copy(energy_x.ptr<float>(y), energy_x.ptr<float>(y) + ncols, pen_x);
+            std::copy(energy_y.ptr<float>(y), energy_y.ptr<float>(y) + ncols, pen_y);
+        }
+
+        // normalize and combine results by multiplying both matches together
+        float * pdst = rtmatch.ptr<float>(y);
+        for (int i = 0; i < ncols; i++)
+        {
+            double qx = ccorr_normalize_value(pnum_x[i], pen_x[i], tnorm_x, 0.0);
+            double qy = ccorr_normalize_value(pnum_y[i], pen_y[i], tnorm_y, 0.0);
+            pdst[i] = static_cast<float>(qx * qy);
+        }
+    }
+}
+
+
+void TOGMatcher::perform_match_quant(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const int ksize,
+    const double mag_frac) const
+{
+    static const std::vector<cv::Mat> vlut = create_quant_response_luts();
+
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+    cv::Mat quant;
+    cv::Mat spread;
+    cv::Mat response[8];
+
+    const int ncols = rsrc.cols - tmpl_dx.cols + 1;
+    const int nrows = rsrc.rows - tmpl_dx.rows + 1;
+
+    // quantize image gradient orientations then spread them
+    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+    quantize_orientations(grad_x, grad_y, mag_frac * quant_mag_max, quant);
+    spread_orientations(quant, TOG_QUANT_SPREAD, spread);
+
+    // precompute score of every image pixel for every orientation
+    for (int k = 0; k < 8; k++)
+    {
+        cv::LUT(spread, vlut[k], response[k]);
+    }
+
+    // each feature adds a shifted row of the response image for its orientation
+    std::vector<ushort> vacc(ncols);
+    const float fscale = (vquant.empty()) ? 0.0f : (1.0f / (4.0f * vquant.size()));
+    rtmatch.create(nrows, ncols, TEMPLATE_DEPTH);
+    for (int y = 0; y < nrows; y++)
+    {
+        std::fill(vacc.begin(), vacc.end(), static_cast<ushort>(0U));
+        ushort * pacc = vacc.data();
+        for (const auto& r : vquant)
+        {
+            const uchar * presp = response[r.ori].ptr<uchar>(y + r.pt.y) + r.pt.x;
+            for (int i = 0; i < ncols; i++)
+            {
+                pacc[i] += presp[i];
+            }
+        }
+
+        float * pdst = rtmatch.ptr<float>(y);
+        for (int i = 0; i < ncols; i++)
+        {
+            pdst[i] = pacc[i] * fscale;
+        }
+    }
+}
+
+
+void TOGMatcher::perform_match_sqdiff_thr(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const double err_thr,
+    const bool is_mask_enabled,
+    const int ksize,
+    const bool is_best_only) const
+{
+    // horizontal run of template pixels in one row
+    typedef struct
+    {
+        int y;
+        int x0;
+        int x1;
+    } run_t;
+
+    // template pixel for partial sums
+    typedef struct
+    {
+        cv::Point pt;
+        float tx;
+        float ty;
+        float mag2;
+    } sqdiff_pt_t;
+
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+    cv::Mat isum;
+    cv::Mat isqsum_x;
+    cv::Mat isqsum_y;
+    std::vector<run_t> vruns;
+    std::vector<double> vrow_norm_x;
+    std::vector<double> vrow_norm_y;
+    std::vector<size_t> vrow_end;
+    std::vector<sqdiff_pt_t> vpts;
+
+    const int ncols = rsrc.cols - tmpl_dx.cols + 1;
+    const int nrows = rsrc.rows - tmpl_dx.rows + 1;
+
+    // calculate X and Y gradient images and integral images of their squares
+    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+    cv::integral(grad_x, isum, isqsum_x, CV_64F, CV_64F);
+    cv::integral(grad_y, isum, isqsum_y, CV_64F, CV_64F);
+
+    // find runs of template pixels (mask pixels or entire rows)
+    // and the template norm of each row
+    // then order the pixels so the strongest template gradients are summed first
+    for (int j = 0; j < tmpl_dx.rows; j++)
+    {
+        const float * pdx = tmpl_dx.ptr<float>(j);
+        const float * pdy = tmpl_dy.ptr<float>(j);
+        const float * pm = tmpl_mask_32F.ptr<float>(j);
+        double qx = 0.0;
+        double qy = 0.0;
+        for (int i = 0; i < tmpl_dx.cols; i++)
+        {
+            const bool is_used = (!is_mask_enabled) || (pm[i] != 0.0f);
+            if (is_used)
+            {
+                if (vruns.empty() || (vruns.back().y != j) || (vruns.back().x1 != i))
+                {
+                    vruns.push_back({ j, i, i + 1 });
+                }
+                else
+                {
+                    vruns.back().x1 = i + 1;
+                }
+                qx += pdx[i] * pdx[i];
+                qy += pdy[i] * pdy[i];
+                vpts.push_back({ { i, j }, pdx[i], pdy[i], (pdx[i] * pdx[i]) + (pdy[i] * pdy[i]) });
+            }
+        }
+        vrow_norm_x.push_back(std::sqrt(qx));
+        vrow_norm_y.push_back(std::sqrt(qy));
+        vrow_end.push_back(vruns.size());
+    }
+    std::stable_sort(vpts.begin(), vpts.end(), [](const sqdiff_pt_t& a, const sqdiff_pt_t& b) { return a.mag2 > b.mag2; });
+
+    double thr = err_thr;
+    rtmatch.create(nrows, ncols, TEMPLATE_DEPTH);
+    for (int y = 0; y < nrows; y++)
+    {
+        float * pdst = rtmatch.ptr<float>(y);
+        for (int x = 0; x < ncols; x++)
+        {
+            // successive elimination bound
+            // by triangle inequality each row error is at least the squared difference of the norms
+            double err = 0.0;
+            size_t n = 0;
+            for (int j = 0; (j < tmpl_dx.rows) && (err <= thr); j++)
+            {
+                const double * px0 = isqsum_x.ptr<double>(y + j);
+                const double * px1 = isqsum_x.ptr<double>(y + j + 1);
+                const double * py0 = isqsum_y.ptr<double>(y + j);
+                const double * py1 = isqsum_y.ptr<double>(y + j + 1);
+                double ex = 0.0;
+                double ey = 0.0;
+                for (; n < vrow_end[j]; n++)
+                {
+                    const int a = x + vruns[n].x0;
+                    const int b = x + vruns[n].x1;
+                    ex += (px1[b] - px1[a]) - (px0[b] - px0[a]);
+                    ey += (py1[b] - py1[a]) - (py0[b] - py0[a]);
+                }
+                const double dx = std::sqrt(std::max(ex, 0.0)) - vrow_norm_x[j];
+                const double dy = std::sqrt(std::max(ey, 0.0)) - vrow_norm_y[j];
+                err += (dx * dx) + (dy * dy);
+            }
+
+            // partial sums over strongest template gradients first
+            // quit as soon as the error is too big
+            if (err <= thr)
+            {
+                // the row bounds are only kept for rejected windows
+                // accepted windows get the exact sum so they agree with perform_match_sqdiff
+                double partial = 0.0;
+                bool is_rejected = false;
+                for (size_t k = 0; k < vpts.size(); k++)
+                {
+                    const sqdiff_pt_t& r = vpts[k];
+                    const float ex = grad_x.ptr<float>(y + r.pt.y)[x + r.pt.x] - r.tx;
+                    const float ey = grad_y.ptr<float>(y + r.pt.y)[x + r.pt.x] - r.ty;
+                    partial += (ex * ex) + (ey * ey);
+                    if (((k & 15U) == 15U) && (partial > thr))
+                    {
+                        is_rejected = true;
+                        break;
+                    }
+                }
+                err = (is_rejected) ? std::max(err, partial) : partial;
+                if (is_best_only && (err < thr))
+                {
+                    thr = err;
+                }
+            }
+
+            // best results for SQDIFF are minimums so do a sign flip
+            pdst[x] = static_cast<float>(-err);
+        }
+    }
+}
+
+
+void TOGMatcher::perform_match_sqdiff(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize)
+{
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+    cv::Mat tmatch_x;
+    cv::Mat tmatch_y;
+
+    // calculate X and Y gradient images
+    Sobel(rsrc, grad_x, TEMPLATE_DEPTH, 1, 0, ksize);
+    Sobel(rsrc, grad_y, TEMPLATE_DEPTH, 0, 1, ksize);
+
+    // perform match with dX and dY magnitude templates
+    // it is up to the user whether or not the mask is enabled
+    if (is_mask_enabled)
+    {
+        matchTemplate(grad_x, tmpl_dx, tmatch_x, cv::TM_SQDIFF, tmpl_mask_32F);
+        matchTemplate(grad_y, tmpl_dy, tmatch_y, cv::TM_SQDIFF, tmpl_mask_32F);
+    }
+    else
+    {
+        matchTemplate(grad_x, tmpl_dx, tmatch_x, cv::TM_SQDIFF);
+        matchTemplate(grad_y, tmpl_dy, tmatch_y, cv::TM_SQDIFF);
+    }
+
+    // combine results by adding match results
+    // best results for SQDIFF are minimums so do a sign flip
+    rtmatch = -(tmatch_x + tmatch_y);
+}
+
+
+void TOGMatcher::update_workspace_dft(
+    const cv::Size& rimg_size,
+    const bool is_mask_enabled,
+    TOGMatchWorkspace& rws) const
+{
+    // template is compared with the copy that the spectra were made from
+    // since a workspace could be used with more than one template
+    if ((rimg_size == rws.dft_img_size) &&
+        (is_mask_enabled == rws.is_dft_mask_enabled) &&
+        is_same_data(tmpl_dx, rws.dft_tmpl_dx) &&
+        is_same_data(tmpl_dy, rws.dft_tmpl_dy) &&
+        is_same_data(tmpl_mask_32F, rws.dft_tmpl_mask))
+    {
+        ///////
+        return;
+        ///////
+    }
+
+    rws.dft_img_size = rimg_size;
+    rws.is_dft_mask_enabled = is_mask_enabled;
+    tmpl_dx.copyTo(rws.dft_tmpl_dx);
+    tmpl_dy.copyTo(rws.dft_tmpl_dy);
+    tmpl_mask_32F.copyTo(rws.dft_tmpl_mask);
+
+    // DFT must be big enough to hold entire image so there is no wrap-around
+    rws.dft_size.width = cv::getOptimalDFTSize(rimg_size.width);
+    rws.dft_size.height = cv::getOptimalDFTSize(rimg_size.height);
+
+    // masked correlation is the same as unmasked correlation with a masked template
+    // and masked energy is the correlation of the squared gradients with the mask
+    create_tmpl_spectrum((is_mask_enabled) ? tmpl_dx_masked : tmpl_dx, rws.dft_size, rws.dft_pad, rws.dft_spec_dx);
+    create_tmpl_spectrum((is_mask_enabled) ? tmpl_dy_masked : tmpl_dy, rws.dft_size, rws.dft_pad, rws.dft_spec_dy);
+    if (is_mask_enabled)
+    {
+        create_tmpl_spectrum(tmpl_mask_32F, rws.dft_size, rws.dft_pad, rws.dft_spec_mask);
+    }
+}
+
+
+void TOGMatcher::correlate_workspace(
+    const cv::Mat& rgrad_x,
+    const cv::Mat& rgrad_y,
+    const cv::Mat& rgrad_x2,
+    const cv::Mat& rgrad_y2,
+    TOGMatchWorkspace& rws,
+    const bool is_mask_enabled,
+    double& renergy_min_x,
+    double& renergy_min_y) const
+{
+    const cv::Size result_size(rgrad_x.cols - tmpl_dx.cols + 1, rgrad_x.rows - tmpl_dx.rows + 1);
+
+    update_workspace_dft(rgrad_x.size(), is_mask_enabled, rws);
+
+    // one forward and one inverse DFT for each gradient image
+    correlate_dft(rgrad_x, rws.dft_spec_dx, rws.dft_size, result_size, rws.num_x, rws.dft_pad, rws.dft_img_spec, rws.dft_corr);
+    correlate_dft(rgrad_y, rws.dft_spec_dy, rws.dft_size, result_size, rws.num_y, rws.dft_pad, rws.dft_img_spec, rws.dft_corr);
+
+    renergy_min_x = 0.0;
+    renergy_min_y = 0.0;
+    if (is_mask_enabled)
+    {
+        double energy_max_x;
+        double energy_max_y;
+        correlate_dft(rgrad_x2, rws.dft_spec_mask, rws.dft_size, result_size, rws.energy_x, rws.dft_pad, rws.dft_img_spec, rws.dft_corr);
+        correlate_dft(rgrad_y2, rws.dft_spec_mask, rws.dft_size, result_size, rws.energy_y, rws.dft_pad, rws.dft_img_spec, rws.dft_corr);
+
+        // DFT round-off can leave tiny non-zero energies in flat regions
+        // so treat anything at that level as zero energy (same as perform_match_dft)
+        cv::minMaxLoc(rws.energy_x, nullptr, &energy_max_x);
+        cv::minMaxLoc(rws.energy_y, nullptr, &energy_max_y);
+        renergy_min_x = energy_max_x * 1.0e-7;
+        renergy_min_y = energy_max_y * 1.0e-7;
+    }
+    else
+    {
+        // unmasked window energy is just a box sum of the squared gradients
+        cv::integral(rgrad_x, rws.isum, rws.isqsum, CV_64F, CV_64F);
+        window_sum_sq_integral(rws.isqsum, tmpl_dx.size(), rws.energy_x);
+        cv::integral(rgrad_y, rws.isum, rws.isqsum, CV_64F, CV_64F);
+        window_sum_sq_integral(rws.isqsum, tmpl_dy.size(), rws.energy_y);
+    }
+}
+
+
+void TOGMatcher::normalize_workspace(
+    const TOGMatchWorkspace& rws,
+    const bool is_mask_enabled,
+    const double energy_min_x,
+    const double energy_min_y,
+    cv::Mat& rtmatch) const
+{
+    const double tnorm_x = std::sqrt((is_mask_enabled) ? mask_norm2_dx : norm2_dx);
+    const double tnorm_y = std::sqrt((is_mask_enabled) ? mask_norm2_dy : norm2_dy);
+
+    // normalize and combine results by multiplying both matches together
+    rtmatch.create(rws.num_x.size(), TEMPLATE_DEPTH);
+    for (int y = 0; y < rtmatch.rows; y++)
+    {
+        const float * pnum_x = rws.num_x.ptr<float>(y);
+        const float * pnum_y = rws.num_y.ptr<float>(y);
+        const float * pen_x = rws.energy_x.ptr<float>(y);
+        const float * pen_y = rws.energy_y.ptr<float>(y);
+        float * pdst = rtmatch.ptr<float>(y);
+        for (int i = 0; i < rtmatch.cols; i++)
+        {
+            double qx = ccorr_normalize_value(pnum_x[i], pen_x[i], tnorm_x, energy_min_x);
+            double qy = ccorr_normalize_value(pnum_y[i], pen_y[i], tnorm_y, energy_min_y);
+            pdst[i] = static_cast<float>(qx * qy);
+        }
+    }
+}
+
+
+void TOGMatcher::perform_match_rows(
+    const TOGMatchWorkspace& rgrad,
+    cv::Mat& rtmatch,
+    TOGMatchWorkspace& rws,
+    const cv::Range& rrows,
+    const bool is_mask_enabled,
+    peak_info_t& rpeak) const
+{
+    double energy_min_x;
+    double energy_min_y;
+
+    // result rows only need the gradient rows under them
+    const cv::Range grad_rows(rrows.start, rrows.end + tmpl_dx.rows - 1);
+    correlate_workspace(
+        rgrad.grad_x.rowRange(grad_rows), rgrad.grad_y.rowRange(grad_rows),
+        rgrad.grad_x2.rowRange(grad_rows), rgrad.grad_y2.rowRange(grad_rows),
+        rws, is_mask_enabled, energy_min_x, energy_min_y);
+
+    // output rows are a region of the caller's result so they are written in place
+    cv::Mat tmatch_rows = rtmatch.rowRange(rrows);
+    normalize_workspace(rws, is_mask_enabled, energy_min_x, energy_min_y, tmatch_rows);
+    cv::minMaxLoc(tmatch_rows, nullptr, &rpeak.score, nullptr, &rpeak.pt);
+    rpeak.pt.y += rrows.start;
+    rpeak.ptsub = rpeak.pt;
+}
+
+
+void TOGMatcher::perform_match(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    TOGMatchWorkspace& rws,
+    const bool is_mask_enabled,
+    const int ksize) const
+{
+    double energy_min_x;
+    double energy_min_y;
+
+    calc_workspace_gradients(rsrc, ksize, rws);
+    correlate_workspace(
+        rws.grad_x, rws.grad_y, rws.grad_x2, rws.grad_y2,
+        rws, is_mask_enabled, energy_min_x, energy_min_y);
+    normalize_workspace(rws, is_mask_enabled, energy_min_x, energy_min_y, rtmatch);
+}
+
+
+void TOGMatcher::perform_match_tiled(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    peak_info_t& rpeak,
+    const bool is_mask_enabled,
+    const int ksize,
+    const int tile_rows) const
+{
+    std::vector<TOGMatchWorkspace> vws;
+    perform_match_tiled(rsrc, rtmatch, rpeak, vws, is_mask_enabled, ksize, tile_rows);
+}
+
+
+void TOGMatcher::perform_match_tiled(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    peak_info_t& rpeak,
+    std::vector<TOGMatchWorkspace>& rvws,
+    const bool is_mask_enabled,
+    const int ksize,
+    const int tile_rows) const
+{
+    const int ncols = rsrc.cols - tmpl_dx.cols + 1;
+    const int nrows = rsrc.rows - tmpl_dx.rows + 1;
+
+    // each tile correlates the template height minus one rows below it too
+    // so tiles are at least as tall as the template to keep that overlap under half
+    const int nrows_tile = std::max(std::max(tile_rows, 1), tmpl_dx.rows);
+    const int ntiles = (nrows + nrows_tile - 1) / nrows_tile;
+    const int nstripes = std::max(1, std::min(cv::getNumThreads(), ntiles));
+    std::vector<peak_info_t> vpeaks(ntiles);
+
+    // one workspace for each stripe and one more for the last tile since it can be shorter
+    // so every workspace sees the same size on every frame and is never reallocated
+    // and the last workspace holds the gradients of the whole image
+    rtmatch.create(nrows, ncols, TEMPLATE_DEPTH);
+    if (static_cast<int>(rvws.size()) < (nstripes + 2))
+    {
+        rvws.resize(nstripes + 2);
+    }
+    TOGMatchWorkspace& rgrad = rvws[nstripes + 1];
+
+    // gradients are calculated just once so the overlapping rows are not done again for each tile
+    calc_workspace_gradients(rsrc, ksize, rgrad);
+
+    // one stripe per thread and each stripe has its own workspace
+    // stripes take every Nth tile so the work is spread evenly
+    // each tile writes only to its own rows of the result and its own peak
+    cv::parallel_for_(cv::Range(0, nstripes), [&](const cv::Range& r)
+    {
+        for (int s = r.start; s < r.end; s++)
+        {
+            for (int t = s; t < ntiles; t += nstripes)
+            {
+                const cv::Range rows(t * nrows_tile, std::min((t + 1) * nrows_tile, nrows));
+                TOGMatchWorkspace& rws = (t == (ntiles - 1)) ? rvws[nstripes] : rvws[s];
+                perform_match_rows(rgrad, rtmatch, rws, rows, is_mask_enabled, vpeaks[t]);
+            }
+        }
+    }, nstripes);
+
+    // tiles are in raster order so first tile with the max has the first max
+    rpeak.pt = { 0,0 };
+    rpeak.score = -DBL_MAX;
+    rpeak.ptsub = rpeak.pt;
+    for (const auto& r : vpeaks)
+    {
+        if (r.score > rpeak.score)
+        {
+            rpeak = r;
+        }
+    }
+}
+
+
+void TOGMatcher::perform_match_sqdiff(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    TOGMatchWorkspace& rws,
+    const bool is_mask_enabled,
+    const int ksize) const
+{
+    double energy_min_x;
+    double energy_min_y;
+    const double tnorm2_x = (is_mask_enabled) ? mask_norm2_dx : norm2_dx;
+    const double tnorm2_y = (is_mask_enabled) ? mask_norm2_dy : norm2_dy;
+
+    calc_workspace_gradients(rsrc, ksize, rws);
+    correlate_workspace(
+        rws.grad_x, rws.grad_y, rws.grad_x2, rws.grad_y2,
+        rws, is_mask_enabled, energy_min_x, energy_min_y);
+
+    rtmatch.create(rws.num_x.size(), TEMPLATE_DEPTH);
+    for (int y = 0; y < rtmatch.rows; y++)
+    {
+        const float * pnum_x = rws.num_x.ptr<float>(y);
+        const float * pnum_y = rws.num_y.ptr<float>(y);
+        const float * pen_x = rws.energy_x.ptr<float>(y);
+        const float * pen_y = rws.energy_y.ptr<float>(y);
+
+        // squared difference is image energy minus twice the correlation plus template energy
+        // best results for SQDIFF are minimums so do a sign flip
+        float * pdst = rtmatch.ptr<float>(y);
+        for (int i = 0; i < rtmatch.cols; i++)
+        {
+            double ex = pen_x[i] - (2.0 * pnum_x[i]) + tnorm2_x;
+            double ey = pen_y[i] - (2.0 * pnum_y[i]) + tnorm2_y;
+            pdst[i] = static_cast<float>(-(ex + ey));
+        }
+    }
+}
+
+
+const char * TOGMatcher::get_engine_name(const engine_t engine)
+{
+    switch (engine)
+    {
+        case engine_t::SPATIAL: return "Spatial";
+        case engine_t::DFT: return "DFT";
+        case engine_t::FUSED: return "Fused";
+        case engine_t::SPARSE: return "Sparse";
+        case engine_t::INTEGRAL: return "Integral";
+        case engine_t::TILED: return "Tiled";
+        default: return "Unknown";
+    }
+}
+
+
+void TOGMatcher::perform_match_engine(
+    const engine_t engine,
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize)
+{
+    switch (engine)
+    {
+        case engine_t::DFT:
+        {
+            perform_match_dft(rsrc, rtmatch, is_mask_enabled, ksize);
+            break;
+        }
+        case engine_t::FUSED:
+        {
+            perform_match_fused(rsrc, rtmatch, is_mask_enabled, ksize);
+            break;
+        }
+        case engine_t::SPARSE:
+        {
+            perform_match_sparse(rsrc, rtmatch, is_mask_enabled, ksize);
+            break;
+        }
+        case engine_t::INTEGRAL:
+        {
+            perform_match_integral(rsrc, rtmatch, is_mask_enabled, ksize);
+            break;
+        }
+        case engine_t::TILED:
+        {
+            peak_info_t peak;
+            perform_match_tiled(rsrc, rtmatch, peak, is_mask_enabled, ksize);
+            break;
+        }
+        case engine_t::SPATIAL:
+        default:
+        {
+            perform_match(rsrc, rtmatch, is_mask_enabled, ksize);
+            break;
+        }
+    }
+}
+
+
+void TOGMatcher::calibrate_engines(
+    const cv::Mat& rsample,
+    const bool is_mask_enabled,
+    const int ksize,
+    const int trials)
+{
+    cv::Mat tmatch;
+    double best_msec = DBL_MAX;
+
+    calib_img_size = rsample.size();
+    is_calib_mask_enabled = is_mask_enabled;
+    calib_ksize = ksize;
+    calib_engine = engine_t::SPATIAL;
+    vcalib_msec.assign(static_cast<size_t>(engine_t::COUNT), -1.0);
+
+    for (int i = 0; i < static_cast<int>(engine_t::COUNT); i++)
+    {
+        const engine_t engine = static_cast<engine_t>(i);
+
+        // sparse engine with a limit on template pixels is not the same match
+        if ((engine == engine_t::SPARSE) && (sparse_max_pts != 0))
+        {
+            continue;
+        }
+
+        // first run fills any caches (such as DFT spectra) so it is not a fair time
+        // but if it is already much slower than the best engine there is no need to run it again
+        // otherwise keep fastest of the timed runs
+        int64 tw0 = cv::getTickCount();
+        perform_match_engine(engine, rsample, tmatch, is_mask_enabled, ksize);
+        int64 tw1 = cv::getTickCount();
+        double msec = 1000.0 * static_cast<double>(tw1 - tw0) / cv::getTickFrequency();
+        if (msec > (best_msec * TOG_CALIB_WARMUP_FACTOR))
+        {
+            vcalib_msec[i] = msec;
+            continue;
+        }
+
+        msec = DBL_MAX;
+        for (int n = 0; n < std::max(trials, 1); n++)
+        {
+            int64 t0 = cv::getTickCount();
+            perform_match_engine(engine, rsample, tmatch, is_mask_enabled, ksize);
+            int64 t1 = cv::getTickCount();
+            msec = std::min(msec, 1000.0 * static_cast<double>(t1 - t0) / cv::getTickFrequency());
+        }
+
+        vcalib_msec[i] = msec;
+        if (msec < best_msec)
+        {
+            best_msec = msec;
+            calib_engine = engine;
+        }
+    }
+}
+
+
+void TOGMatcher::calibrate_engines(
+    const cv::Size& rimg_size,
+    const bool is_mask_enabled,
+    const int ksize,
+    const int trials)
+{
+    // any texture will do since engine times do not depend much on image content
+    cv::Mat sample(rimg_size, CV_8UC1);
+    cv::RNG(0).fill(sample, cv::RNG::UNIFORM, 0, 256);
+    calibrate_engines(sample, is_mask_enabled, ksize, trials);
+}
+
+
+void TOGMatcher::perform_match_auto(
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    const bool is_mask_enabled,
+    const int ksize)
+{
+    if ((rsrc.size() != calib_img_size) ||
+        (is_mask_enabled != is_calib_mask_enabled) ||
+        (ksize != calib_ksize))
+    {
+        calibrate_engines(rsrc, is_mask_enabled, ksize);
+    }
+
+    perform_match_engine(calib_engine, rsrc, rtmatch, is_mask_enabled, ksize);
 }
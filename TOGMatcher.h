@@ -23,6 +23,7 @@
 #ifndef TOG_MATCHER_H_
 #define TOG_MATCHER_H_
 
+#include <vector>
 #include "opencv2/imgproc.hpp"
 
 
@@ -35,11 +36,161 @@
 // A value of 0.0 is a good starting point
 #define TOG_DEFAULT_MAG_THR (0.00)
 
+// Number of reduced-resolution template levels for pyramid search
+// Each level is half the size of the previous level
+#define TOG_DEFAULT_PYR_LEVELS  (2)
+
+// Number of best candidates from each pyramid level that are refined at the next level
+#define TOG_DEFAULT_PYR_TOPK    (8)
+
+// Half-size of search window (in pixels) around each candidate at the next finer level
+#define TOG_PYR_SEARCH_RADIUS   (3)
+
+// Templates are not reduced if any dimension would be smaller than this
+#define TOG_PYR_MIN_SIZE        (8)
+
+// Maximum number of template points for CV_16S matching in perform_match
+// The CV_16S path is a spatial loop with cost proportional to image size times points
+// so larger templates use the DFT-based CV_32F path even if CV_16S is selected
+#define TOG_INT16_MAX_POINTS    (1024)
+
+// Number of match result rows in each tile for tiled matching
+// Each tile also reads the template height minus one rows below it
+// so tiles are never shorter than the template
+#define TOG_DEFAULT_TILE_ROWS   (64)
+
+// Number of times each engine is run when timing the engines (fastest time is kept)
+#define TOG_DEFAULT_CALIB_TRIALS    (3)
+
+// First run of an engine fills its caches so it is slower than later runs
+// An engine is only skipped if its first run is this many times slower than the fastest engine so far
+#define TOG_CALIB_WARMUP_FACTOR     (4.0)
+
+// Fraction (0.0-1.0) of template energy kept by the low-rank separable approximation
+#define TOG_DEFAULT_LOWRANK_ENERGY  (0.99)
+
+// Maximum number of separable components kept for each low-rank template
+#define TOG_DEFAULT_LOWRANK_MAX     (8)
+
+// Minimum gradient magnitude for an image pixel to get an orientation in quantized matching
+// This is a fraction (0.0-1.0) of the max template gradient magnitude (like the mask threshold)
+// so it follows the gain of the Sobel kernel size
+#define TOG_DEFAULT_QUANT_MAG_FRAC  (0.015)
+
+// Orientations are spread over a square of this half-size in quantized matching
+// This makes the match tolerant to small shifts and deformations
+#define TOG_QUANT_SPREAD        (1)
+
+// Maximum number of template features for quantized matching
+// Scores are accumulated in 16-bit integers so this must stay below 16384
+#define TOG_QUANT_MAX_FEATURES  (8191)
+
+
+// Buffers for the intermediate images of a match that can be reused for every frame.
+// They are sized on the first match with a new image size and then left alone
+// so matching frames of the same size does no heap allocations.
+class TOGMatchWorkspace
+{
+public:
+
+    TOGMatchWorkspace() : is_dft_mask_enabled(false) {}
+    virtual ~TOGMatchWorkspace() {}
+
+    // X and Y gradient images and their squares
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+    cv::Mat grad_x2;
+    cv::Mat grad_y2;
+
+    // image size and mask setting for the cached template spectra
+    // and copy of the template they were made from (workspace may be used with other templates)
+    cv::Size dft_img_size;
+    bool is_dft_mask_enabled;
+    cv::Mat dft_tmpl_dx;
+    cv::Mat dft_tmpl_dy;
+    cv::Mat dft_tmpl_mask;
+
+    // DFT size and template spectra for whole image correlations
+    cv::Size dft_size;
+    cv::Mat dft_spec_dx;
+    cv::Mat dft_spec_dy;
+    cv::Mat dft_spec_mask;
+
+    // padded image, its spectrum, and correlation for each DFT round-trip
+    cv::Mat dft_pad;
+    cv::Mat dft_img_spec;
+    cv::Mat dft_corr;
+
+    // integral images for unmasked window energies
+    cv::Mat isum;
+    cv::Mat isqsum;
+
+    // raw correlations and window energies (same size as match result)
+    cv::Mat num_x;
+    cv::Mat num_y;
+    cv::Mat energy_x;
+    cv::Mat energy_y;
+};
+
 
 class TOGMatcher
 {
 public:
-    
+
+    // location and score of a match result
+    typedef struct
+    {
+        cv::Point pt;       // upper-left corner of template in match result
+        double score;       // value of match result at that location
+        cv::Point2f ptsub;  // sub-pixel location of peak (if available)
+    } peak_info_t;
+
+    // one template pixel for sparse matching
+    typedef struct
+    {
+        cv::Point pt;       // location in template
+        float dx;           // X gradient value
+        float dy;           // Y gradient value
+        float w;            // weight of image pixel for window energy
+    } sparse_pt_t;
+
+    // one template pixel for matching with CV_16S gradients
+    typedef struct
+    {
+        cv::Point pt;       // location in template
+        short dx;           // X gradient value
+        short dy;           // Y gradient value
+    } int16_pt_t;
+
+    // one template feature for quantized matching
+    typedef struct
+    {
+        cv::Point pt;       // location in template
+        int ori;            // orientation bin 0-7 (45 degrees each)
+    } quant_feature_t;
+
+    // matching engines that give the same result as perform_match
+    enum class engine_t : int
+    {
+        SPATIAL = 0,
+        DFT,
+        FUSED,
+        SPARSE,
+        INTEGRAL,
+        TILED,
+        COUNT,
+    };
+
+    // low-rank separable approximation of a template
+    // the template is approximated by the sum of each column kernel times its row kernel
+    typedef struct
+    {
+        std::vector<cv::Mat> vcol;  // column kernels (scaled by singular values)
+        std::vector<cv::Mat> vrow;  // row kernels
+        double norm2;               // squared norm of approximation
+        double err;                 // norm of approximation error relative to template norm
+    } lowrank_tmpl_t;
+
     TOGMatcher();
     virtual ~TOGMatcher();
 
@@ -52,24 +203,331 @@ public:
         const cv::Mat& rsrc,
         const int ksize = TOG_DEFAULT_KSIZE,
         const double mag_thr = TOG_DEFAULT_MAG_THR);
+
+    // creates template from X and Y gradient images that have already been computed
+    // this allows templates to be made from gradients that were transformed (rotated, scaled)
+    // the gradients must be CV_32F and made with the same Sobel kernel size used for matching
+    void create_template_from_gradients(
+        const cv::Mat& rgrad_x,
+        const cv::Mat& rgrad_y,
+        const double mag_thr = TOG_DEFAULT_MAG_THR);
     
+    // creates template from data that was already compiled by another matcher
+    // (see TOGLibrary) so the mask and contours do not have to be recalculated
+    // every create function builds the pyramid from the cropped template gradients
+    // so this gives the same template as the function that compiled the data
+    void create_template_from_compiled(
+        const cv::Mat& rdx,
+        const cv::Mat& rdy,
+        const cv::Mat& rmask,
+        const std::vector<std::vector<cv::Point>>& rcontours,
+        const cv::Point& roffset,
+        const double mag_thr = TOG_DEFAULT_MAG_THR);
+
     void perform_match(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE) const;
+
+    // selects depth of image gradients for perform_match (CV_32F or CV_16S)
+    // CV_16S gradients are correlated with int32 accumulators then normalized as floats
+    // this path is used only for CV_8U images with ksize -1, 1, or 3
+    // and only if the template cannot overflow the accumulators, otherwise CV_32F is used
+    // the CV_16S path correlates point by point so its cost is image size times template points
+    // instead of the DFT cost of the CV_32F path, so it is also skipped for templates
+    // with more than TOG_INT16_MAX_POINTS points
+    // template values are rounded to integers so the CV_16S path is exact up to the final
+    // normalization for templates made from 8-bit images (results agree with the CV_32F path
+    // to within its own float round-off, about 1e-6), templates made from transformed
+    // gradients also get the rounding error of their values
+    void set_gradient_depth(const int depth) { grad_depth = depth; }
+    int get_gradient_depth(void) const { return grad_depth; }
+
+    // performs match on X and Y gradient images that have already been computed
+    // this lets multiple templates share the gradient calculations for one image
+    void perform_match_grad(
+        const cv::Mat& rgrad_x,
+        const cv::Mat& rgrad_y,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true) const;
+
+    // performs same match as perform_match but does the correlations with DFTs
+    // the template spectra are cached and only recalculated if the image size changes
+    // this is much faster than the spatial match for large templates
+    void perform_match_dft(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE);
+
+    // performs same match as perform_match but the default Sobel kernel size (1) gradients
+    // are calculated on the fly inside the correlation loop (SIMD where available)
+    // so no intermediate gradient images are ever written to memory
+    // other kernel sizes and non 8-bit images fall back to perform_match
+    void perform_match_fused(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE) const;
+
+    // performs match with image window energies for masked matching
+    // taken from integral images if the mask is a rectangle
+    // or from one correlation of the squared gradients with the mask otherwise
+    // the masked template norms are calculated when the template is created
+    void perform_match_integral(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE) const;
+
+    // performs same match as perform_match_integral but with gradients provided by the caller
+    void perform_match_grad_integral(
+        const cv::Mat& rgrad_x,
+        const cv::Mat& rgrad_y,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true) const;
+
+    // performs coarse-to-fine match using the reduced-resolution templates
+    // the coarsest level is searched in full and then only the neighborhoods
+    // of the best candidates are searched at each finer level
+    // the match result is the same size as with perform_match but it is
+    // zero everywhere except in the full-resolution neighborhoods that were searched
+    void perform_match_pyramid(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE);
+
+    // masked matches can have NaN or Inf in flat image regions
+    // so this zeros any values that are not valid normalized results
+    static void zero_invalid_results(cv::Mat& rtmatch);
+
+    // finds up to k best peaks in a match result that are at least the threshold
+    // a peak suppresses any lower peak within a window of the NMS size centered on it
+    // sub-pixel locations come from a quadratic fit of the peak and its neighbors
+    // this is done in one pass over the match result that keeps the best local maxima in a bounded heap
+    // then greedy NMS is run on the heap so result is same as greedy NMS over all local maxima
+    // (local maxima are never adjacent so a NMS window holds at most (w/2+1)*(h/2+1) of them
+    // and a heap of k times that many holds every local max that greedy NMS would look at)
+    // peaks are sorted from best to worst (equal scores are in raster order)
+    static void find_peaks(
+        const cv::Mat& rtmatch,
+        const int k,
+        const double thr,
+        const cv::Size& rnms_size,
+        std::vector<peak_info_t>& rvpeaks);
+
+    // finds up to k best peaks with a NMS window the size of the template
+    void find_match_peaks(
+        const cv::Mat& rtmatch,
+        const int k,
+        const double thr,
+        std::vector<peak_info_t>& rvpeaks) const;
+
+    // sets number of pyramid levels and candidates for pyramid search
+    // this must be set before a template is created
+    void set_pyramid_params(
+        const int levels = TOG_DEFAULT_PYR_LEVELS,
+        const int topk = TOG_DEFAULT_PYR_TOPK);
+
+    // performs match with the gradients packed into one complex image (dX + i*dY)
+    // the image is correlated with the complex template in one complex DFT round-trip
+    // and the real part is the sum of dot products of image and template gradients
+    // the score is that sum divided by the norms of the image window and template gradients
+    // so it is the cosine of the angle between them (-1.0 to 1.0) and is not the product
+    // of the separate X and Y scores of perform_match, it can be compared across templates
+    // the template spectrum is cached and only recalculated if the image size changes
+    void perform_match_complex(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE);
+
+    // performs match with low-rank separable approximations of the dX and dY templates
+    // each template is factored with an SVD and the correlation is
+    // a sum of separable filters (one column and one row filter for each component)
+    // this is much faster than the spatial match for large templates that are nearly low-rank
+    // factoring is off by default so it does not slow down template creation
+    // and it falls back to perform_match until it is enabled with set_lowrank_params
+    void perform_match_lowrank(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE) const;
+
+    // sets fraction of template energy to keep in low-rank approximations
+    // and maximum number of separable components for each template
+    // this enables low-rank factoring for the current template and every new template
+    void set_lowrank_params(
+        const double energy = TOG_DEFAULT_LOWRANK_ENERGY,
+        const int max_rank = TOG_DEFAULT_LOWRANK_MAX);
+
+    // gets low-rank approximation of dX (index 0) or dY (index 1) template
+    const lowrank_tmpl_t& get_lowrank_template(const bool is_mask_enabled, const int index) const
+    {
+        return (is_mask_enabled) ? lowrank_masked[index] : lowrank_all[index];
+    }
+
+    // gets ratio of filter taps for the full templates to taps for the separable components
+    double get_lowrank_speedup(const bool is_mask_enabled) const;
+
+    // performs same match as perform_match with a specific engine
+    void perform_match_engine(
+        const engine_t engine,
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE);
+
+    // times every engine that gives the same result as perform_match on a sample image
+    // and selects the fastest one for images of that size with the same mask and ksize
+    // sparse engine is skipped if it has a limit on template pixels since it is not exact
+    // first run of each engine is timed too and an engine that is already much slower
+    // than the fastest engine so far is not run again (its first time is reported)
+    void calibrate_engines(
+        const cv::Mat& rsample,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE,
+        const int trials = TOG_DEFAULT_CALIB_TRIALS);
+
+    // same as calibrate_engines but with a noise image of the given size as the sample
+    // so engines can be calibrated when a template is loaded instead of on the first frame
+    void calibrate_engines(
+        const cv::Size& rimg_size,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE,
+        const int trials = TOG_DEFAULT_CALIB_TRIALS);
+
+    // performs match with the engine that was selected by calibration
+    // engines are calibrated again with this image if the image size, mask, ksize,
+    // or template is different from the last calibration
+    // (call calibrate_engines after creating a template to avoid a slow first frame)
+    void perform_match_auto(
         const cv::Mat& rsrc,
         cv::Mat& rtmatch,
         const bool is_mask_enabled = true,
         const int ksize = TOG_DEFAULT_KSIZE);
 
+    // gets engine selected by last calibration
+    engine_t get_engine(void) const { return calib_engine; }
+
+    // gets time (msec) for each engine from last calibration (negative if engine was skipped)
+    const std::vector<double>& get_engine_timings(void) const { return vcalib_msec; }
+
+    static const char * get_engine_name(const engine_t engine);
+
+    // performs match by correlating only the template pixels that can contribute
+    // (pixels that survive the magnitude mask, or non-zero pixels if mask is disabled)
+    // this is much faster than the spatial match for outline-style templates
+    void perform_match_sparse(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE) const;
+
+    // sets limit on number of template pixels used for sparse matching (0 for no limit)
+    // only the pixels with the strongest gradients are kept
+    // with a limit the template is matched like a masked template made of the kept pixels
+    void set_sparse_max_points(const size_t n);
+
+    const std::vector<sparse_pt_t>& get_sparse_points(const bool is_mask_enabled) const
+    {
+        return (is_mask_enabled) ? vsparse_masked : vsparse_all;
+    }
+
+    // performs match with gradient orientations quantized into 8 bins
+    // each feature scores 4 if the same orientation is found near its location
+    // or 1 if an adjacent orientation is found, result is normalized to 0.0-1.0
+    // the template features are the pixels that survive the magnitude mask
+    // image pixels with a magnitude below mag_frac of the max template magnitude get no orientation
+    void perform_match_quant(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const int ksize = TOG_DEFAULT_KSIZE,
+        const double mag_frac = TOG_DEFAULT_QUANT_MAG_FRAC) const;
+
+    const std::vector<quant_feature_t>& get_quant_features(void) const { return vquant; }
+    double get_quant_mag_max(void) const { return quant_mag_max; }
+
     void TOGMatcher::perform_match_sqdiff(
         const cv::Mat& rsrc,
         cv::Mat& rtmatch,
         const bool is_mask_enabled,
         const int ksize);
 
+    // performs same match as perform_match using buffers from a workspace
+    // and writes the result into the caller's output matrix
+    // the correlations are done with DFTs and the template spectra are cached in the workspace
+    // the default Sobel kernel size (1) gradients of an 8-bit image are calculated directly
+    // so once the workspace and output have the right size for the image there are no heap allocations
+    // other kernel sizes use Sobel which can allocate its own scratch buffers
+    // CV_16S gradient depth setting is ignored
+    void perform_match(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        TOGMatchWorkspace& rws,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE) const;
+
+    // performs same match as perform_match with a workspace but splits the image into
+    // horizontal tiles that overlap by the template height and matches them in parallel
+    // gradients are calculated once for the whole image then each tile correlates its rows
+    // with DFTs (template spectra are cached for the tile size) and finds its best score
+    // the match result is same as perform_match (within float round-off)
+    // and the best match is the first max of the result in raster order like minMaxLoc
+    // only the single best match is found (use find_peaks on the result for more peaks)
+    // this version allocates a workspace for each thread on every call
+    void perform_match_tiled(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        peak_info_t& rpeak,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE,
+        const int tile_rows = TOG_DEFAULT_TILE_ROWS) const;
+
+    // performs same match as perform_match_tiled with one workspace for each thread
+    // the workspaces are added if needed and can be reused for every frame
+    void perform_match_tiled(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        peak_info_t& rpeak,
+        std::vector<TOGMatchWorkspace>& rvws,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE,
+        const int tile_rows = TOG_DEFAULT_TILE_ROWS) const;
+
+    // performs same match as perform_match_sqdiff using buffers from a workspace
+    // (see perform_match with a workspace)
+    void perform_match_sqdiff(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        TOGMatchWorkspace& rws,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE) const;
+
+    // performs SQDIFF match but only finds the full error for windows below an error threshold
+    // other windows are rejected by lower bounds on the error from integral images of the
+    // squared gradients (successive elimination with one bound for each template row)
+    // or when a partial sum over the strongest template gradients goes above the threshold
+    // accepted windows get the negated error like perform_match_sqdiff and rejected windows
+    // get a negated lower bound on their error so they are always worse than the threshold
+    // so the best match is the same as perform_match_sqdiff if its error is below the threshold
+    // if is_best_only is set, the threshold is lowered to the best error found so far
+    void perform_match_sqdiff_thr(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const double err_thr,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE,
+        const bool is_best_only = false) const;
+
     const cv::Mat& get_template_mask(void) const { return tmpl_mask_32F; }
     const cv::Mat& get_template_dx(void) const { return tmpl_dx; }
     const cv::Mat& get_template_dy(void) const { return tmpl_dy; }
-    const std::vector<std::vector<cv::Point>>& get_contours() { return src_contours; }
+    const std::vector<std::vector<cv::Point>>& get_contours() const { return src_contours; }
     const cv::Point& get_template_offset(void) const { return tmpl_offset; }
+    const std::vector<TOGMatcher>& get_pyramid(void) const { return vpyr; }
 
 private:
 
@@ -78,6 +536,78 @@ private:
         const int ksize,
         const double mag_thr);
 
+    void create_templates_from_gradients(
+        const cv::Mat& rgrad_x,
+        const cv::Mat& rgrad_y,
+        const double mag_thr);
+
+    void create_pyramid_from_gradients(
+        const cv::Mat& rgrad_x,
+        const cv::Mat& rgrad_y,
+        const double mag_thr);
+
+    void update_template_data(void);
+
+    void compile_sparse_points(void);
+
+    void compile_int16_points(void);
+
+    bool is_int16_match_ok(const cv::Mat& rsrc, const int ksize, const bool is_mask_enabled) const;
+
+    void perform_match_int16(
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        const bool is_mask_enabled,
+        const int ksize) const;
+
+    void compile_quant_features(void);
+
+    void compile_lowrank_templates(void);
+
+    // matches a range of rows of the match result (output must already be created)
+    // using the gradients in another workspace and finds the best match in those rows
+    void perform_match_rows(
+        const TOGMatchWorkspace& rgrad,
+        cv::Mat& rtmatch,
+        TOGMatchWorkspace& rws,
+        const cv::Range& rrows,
+        const bool is_mask_enabled,
+        peak_info_t& rpeak) const;
+
+    // makes template spectra in a workspace if image size, mask setting, or template changed
+    void update_workspace_dft(
+        const cv::Size& rimg_size,
+        const bool is_mask_enabled,
+        TOGMatchWorkspace& rws) const;
+
+    // calculates raw correlations and window energies of gradient images in workspace buffers
+    // masked energies come from a DFT so tiny values in flat regions are round-off (below energy min)
+    void correlate_workspace(
+        const cv::Mat& rgrad_x,
+        const cv::Mat& rgrad_y,
+        const cv::Mat& rgrad_x2,
+        const cv::Mat& rgrad_y2,
+        TOGMatchWorkspace& rws,
+        const bool is_mask_enabled,
+        double& renergy_min_x,
+        double& renergy_min_y) const;
+
+    // normalizes workspace correlations and combines X and Y matches into the result
+    void normalize_workspace(
+        const TOGMatchWorkspace& rws,
+        const bool is_mask_enabled,
+        const double energy_min_x,
+        const double energy_min_y,
+        cv::Mat& rtmatch) const;
+
+    void update_dft_cache(
+        const cv::Size& rimg_size,
+        const bool is_mask_enabled);
+
+    void update_dft_complex_cache(
+        const cv::Size& rimg_size,
+        const bool is_mask_enabled);
+
     // Gradient magnitude mask for template
     cv::Mat tmpl_mask_32F;  
     
@@ -92,6 +622,106 @@ private:
 
     // Contour(s) of template that can be drawn onto an image
     std::vector<std::vector<cv::Point>> src_contours;
+
+    // dX and dY templates with mask applied for masked matching
+    cv::Mat tmpl_dx_masked;
+    cv::Mat tmpl_dy_masked;
+
+    // Squared norms of masked dX and dY templates
+    double mask_norm2_dx;
+    double mask_norm2_dy;
+
+    // Squared norms of dX and dY templates without mask
+    double norm2_dx;
+    double norm2_dy;
+
+    // Flag for mask that covers entire template rectangle
+    bool is_mask_rect;
+
+    // Image size and mask setting for cached DFT data
+    cv::Size dft_img_size;
+    bool is_dft_mask_enabled;
+
+    // Optimal DFT size for cached DFT data
+    cv::Size dft_size;
+
+    // Cached spectra of dX and dY templates (mask applied if enabled)
+    cv::Mat dft_tmpl_dx;
+    cv::Mat dft_tmpl_dy;
+
+    // Cached complex spectrum of mask for image energy calculation
+    cv::Mat dft_tmpl_mask;
+
+    // Squared norms of dX and dY templates (mask applied if enabled)
+    double dft_norm2_dx;
+    double dft_norm2_dy;
+
+    // Image size and mask setting for cached complex DFT data
+    cv::Size dft_cplx_img_size;
+    bool is_dft_cplx_mask_enabled;
+
+    // Optimal DFT size for cached complex DFT data
+    cv::Size dft_cplx_size;
+
+    // Cached complex spectrum of dX + i*dY template (mask applied if enabled)
+    cv::Mat dft_tmpl_cplx;
+
+    // Squared norm of complex template (mask applied if enabled)
+    double dft_cplx_norm2;
+
+    // Template pixels for sparse matching with and without the mask
+    std::vector<sparse_pt_t> vsparse_masked;
+    std::vector<sparse_pt_t> vsparse_all;
+
+    // Limit on number of template pixels for sparse matching (0 for no limit)
+    size_t sparse_max_pts;
+
+    // Template features for quantized matching
+    std::vector<quant_feature_t> vquant;
+
+    // Max template gradient magnitude for quantized matching
+    double quant_mag_max;
+
+    // Depth of image gradients for perform_match
+    int grad_depth;
+
+    // Template pixels for CV_16S matching with and without the mask
+    std::vector<int16_pt_t> vint16_masked;
+    std::vector<int16_pt_t> vint16_all;
+
+    // Sums of absolute template values for checking accumulator range
+    // with and without the mask (index 0 is dX, index 1 is dY)
+    double int16_abs_sum_masked[2];
+    double int16_abs_sum_all[2];
+
+    // Fraction of template energy and maximum number of components for low-rank templates
+    // and flag for factoring templates when they are created
+    double lowrank_energy;
+    int lowrank_max;
+    bool is_lowrank_enabled;
+
+    // Low-rank approximations of dX and dY templates with and without the mask
+    // (index 0 is dX, index 1 is dY)
+    lowrank_tmpl_t lowrank_masked[2];
+    lowrank_tmpl_t lowrank_all[2];
+
+    // Image size, mask setting, and ksize for last engine calibration
+    cv::Size calib_img_size;
+    bool is_calib_mask_enabled;
+    int calib_ksize;
+
+    // Fastest engine and time for every engine from last calibration
+    engine_t calib_engine;
+    std::vector<double> vcalib_msec;
+
+    // Number of reduced-resolution levels to create for pyramid search
+    int pyr_levels;
+
+    // Number of candidates to refine at each pyramid level
+    int pyr_topk;
+
+    // Reduced-resolution templates (first one is half resolution)
+    std::vector<TOGMatcher> vpyr;
 };
 
 #endif // TOG_MATCHER_H_
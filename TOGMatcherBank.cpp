@@ -0,0 +1,96 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include "TOGMatcherBank.h"
+
+
+TOGMatcherBank::TOGMatcherBank() :
+    ksize(TOG_DEFAULT_KSIZE)
+{
+}
+
+
+TOGMatcherBank::~TOGMatcherBank()
+{
+}
+
+
+void TOGMatcherBank::init(const int ksize)
+{
+    this->ksize = ksize;
+    vmatchers.clear();
+}
+
+
+void TOGMatcherBank::add_template_from_file(const char * s, const double mag_thr)
+{
+    vmatchers.push_back(TOGMatcher());
+    vmatchers.back().create_template_from_file(s, ksize, mag_thr);
+}
+
+
+void TOGMatcherBank::add_template_from_img(const cv::Mat& rsrc, const double mag_thr)
+{
+    vmatchers.push_back(TOGMatcher());
+    vmatchers.back().create_template_from_img(rsrc, ksize, mag_thr);
+}
+
+
+void TOGMatcherBank::perform_match(
+    const cv::Mat& rsrc,
+    std::vector<cv::Mat>& rvtmatch,
+    std::vector<TOGMatcher::peak_info_t>& rvpeaks,
+    const bool is_mask_enabled) const
+{
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+
+    // calculate X and Y gradient images just once for all templates
+    Sobel(rsrc, grad_x, CV_32F, 1, 0, ksize);
+    Sobel(rsrc, grad_y, CV_32F, 0, 1, ksize);
+
+    perform_match_grad(grad_x, grad_y, rvtmatch, rvpeaks, is_mask_enabled);
+}
+
+
+void TOGMatcherBank::perform_match_grad(
+    const cv::Mat& rgrad_x,
+    const cv::Mat& rgrad_y,
+    std::vector<cv::Mat>& rvtmatch,
+    std::vector<TOGMatcher::peak_info_t>& rvpeaks,
+    const bool is_mask_enabled) const
+{
+    rvtmatch.resize(vmatchers.size());
+    rvpeaks.resize(vmatchers.size());
+
+    // each template writes only to its own result slots
+    // so the templates can be spread across all available cores
+    cv::parallel_for_(cv::Range(0, static_cast<int>(vmatchers.size())), [&](const cv::Range& r)
+    {
+        for (int i = r.start; i < r.end; i++)
+        {
+            TOGMatcher::peak_info_t& rpeak = rvpeaks[i];
+            vmatchers[i].perform_match_grad(rgrad_x, rgrad_y, rvtmatch[i], is_mask_enabled);
+            cv::minMaxLoc(rvtmatch[i], nullptr, &rpeak.score, nullptr, &rpeak.pt);
+        }
+    });
+}
@@ -0,0 +1,82 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef TOG_MATCHER_BANK_H_
+#define TOG_MATCHER_BANK_H_
+
+#include <vector>
+#include "opencv2/imgproc.hpp"
+#include "TOGMatcher.h"
+
+
+// Collection of TOGMatcher templates that are matched against the same image.
+// The X and Y gradients of the image are calculated once and shared by all
+// the templates.  The templates are then matched in parallel.
+class TOGMatcherBank
+{
+public:
+
+    TOGMatcherBank();
+    virtual ~TOGMatcherBank();
+
+    // clears all templates and sets Sobel kernel size for the bank
+    // every template in the bank must use the same kernel size as the image gradients
+    void init(const int ksize = TOG_DEFAULT_KSIZE);
+
+    void add_template_from_file(
+        const char * s,
+        const double mag_thr = TOG_DEFAULT_MAG_THR);
+
+    void add_template_from_img(
+        const cv::Mat& rsrc,
+        const double mag_thr = TOG_DEFAULT_MAG_THR);
+
+    // matches all templates against the image
+    // there is one match result and one best match (max) for each template
+    void perform_match(
+        const cv::Mat& rsrc,
+        std::vector<cv::Mat>& rvtmatch,
+        std::vector<TOGMatcher::peak_info_t>& rvpeaks,
+        const bool is_mask_enabled = true) const;
+
+    // matches all templates against X and Y gradient images that have already been computed
+    void perform_match_grad(
+        const cv::Mat& rgrad_x,
+        const cv::Mat& rgrad_y,
+        std::vector<cv::Mat>& rvtmatch,
+        std::vector<TOGMatcher::peak_info_t>& rvpeaks,
+        const bool is_mask_enabled = true) const;
+
+    size_t size(void) const { return vmatchers.size(); }
+    int get_ksize(void) const { return ksize; }
+    const TOGMatcher& get_matcher(const size_t i) const { return vmatchers[i]; }
+
+private:
+
+    // Sobel kernel size for all templates and image gradients
+    int ksize;
+
+    // One matcher for each template
+    std::vector<TOGMatcher> vmatchers;
+};
+
+#endif // TOG_MATCHER_BANK_H_
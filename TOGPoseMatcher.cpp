@@ -0,0 +1,258 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+#include "opencv2/imgcodecs.hpp"
+#include "TOGPoseMatcher.h"
+
+
+// masked matches can have invalid values in flat regions of the image
+// so those are zeroed before finding the best match
+static void find_best_match(cv::Mat& rtmatch, TOGMatcher::peak_info_t& rpeak)
+{
+    TOGMatcher::zero_invalid_results(rtmatch);
+    cv::minMaxLoc(rtmatch, nullptr, &rpeak.score, nullptr, &rpeak.pt);
+}
+
+
+// returns true if template fits inside image
+static inline bool is_template_fit(const TOGMatcher& rmatcher, const cv::Size& rimg_size)
+{
+    const cv::Size tsize = rmatcher.get_template_dx().size();
+    return (tsize.width <= rimg_size.width) && (tsize.height <= rimg_size.height);
+}
+
+
+TOGPoseMatcher::TOGPoseMatcher() :
+    ksize(TOG_DEFAULT_KSIZE),
+    mag_thr(TOG_DEFAULT_MAG_THR)
+{
+}
+
+
+TOGPoseMatcher::~TOGPoseMatcher()
+{
+}
+
+
+void TOGPoseMatcher::init(const int ksize, const double mag_thr)
+{
+    this->ksize = ksize;
+    this->mag_thr = mag_thr;
+    vvariants.clear();
+}
+
+
+void TOGPoseMatcher::create_variants_from_file(
+    const char * s,
+    const double angle_step,
+    const double scale_min,
+    const double scale_max,
+    const double scale_step)
+{
+    cv::Mat tmplsrc = cv::imread(s, cv::IMREAD_GRAYSCALE);
+    create_variants_from_img(tmplsrc, angle_step, scale_min, scale_max, scale_step);
+}
+
+
+void TOGPoseMatcher::create_variants_from_img(
+    const cv::Mat& rsrc,
+    const double angle_step,
+    const double scale_min,
+    const double scale_max,
+    const double scale_step)
+{
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+
+    // gradients of the upright template are calculated just once
+    Sobel(rsrc, grad_x, CV_32F, 1, 0, ksize);
+    Sobel(rsrc, grad_y, CV_32F, 0, 1, ksize);
+
+    const cv::Point2f center(0.5f * (rsrc.cols - 1), 0.5f * (rsrc.rows - 1));
+
+    vvariants.clear();
+    for (double scale = scale_min; scale <= (scale_max + 1.0e-6); scale += scale_step)
+    {
+        for (double angle = 0.0; angle < (360.0 - 1.0e-6); angle += angle_step)
+        {
+            cv::Mat rot_x;
+            cv::Mat rot_y;
+
+            // find size of image that holds the entire rotated and scaled template
+            // then shift the transform so the template is centered in it
+            cv::Mat rmat = cv::getRotationMatrix2D(center, angle, scale);
+            const double ca = std::fabs(rmat.at<double>(0, 0));
+            const double sa = std::fabs(rmat.at<double>(0, 1));
+            const cv::Size dsize(
+                static_cast<int>(std::ceil((ca * rsrc.cols) + (sa * rsrc.rows))),
+                static_cast<int>(std::ceil((sa * rsrc.cols) + (ca * rsrc.rows))));
+            rmat.at<double>(0, 2) += (0.5 * (dsize.width - 1)) - center.x;
+            rmat.at<double>(1, 2) += (0.5 * (dsize.height - 1)) - center.y;
+
+            // move the gradient images
+            cv::warpAffine(grad_x, rot_x, rmat, dsize, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+            cv::warpAffine(grad_y, rot_y, rmat, dsize, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+
+            // then rotate the gradient vectors to match
+            // gradients also shrink as the template gets bigger
+            const double rad = angle * CV_PI / 180.0;
+            const float c = static_cast<float>(std::cos(rad) / scale);
+            const float s = static_cast<float>(std::sin(rad) / scale);
+            cv::Mat new_x = (rot_x * c) + (rot_y * s);
+            cv::Mat new_y = (rot_y * c) - (rot_x * s);
+
+            // one pyramid level is kept for the coarse search
+            vvariants.push_back({ angle, scale, TOGMatcher() });
+            vvariants.back().matcher.set_pyramid_params(1);
+            vvariants.back().matcher.create_template_from_gradients(new_x, new_y, mag_thr);
+        }
+    }
+}
+
+
+bool TOGPoseMatcher::perform_match(
+    const cv::Mat& rsrc,
+    pose_info_t& rpose,
+    const bool is_mask_enabled) const
+{
+    cv::Mat src_half;
+    cv::Mat grad_x;
+    cv::Mat grad_y;
+    cv::Mat grad_half_x;
+    cv::Mat grad_half_y;
+
+    const int nvar = static_cast<int>(vvariants.size());
+    std::vector<TOGMatcher::peak_info_t> vcoarse(nvar, { { 0, 0 }, 0.0 });
+    std::vector<TOGMatcher::peak_info_t> vfine(nvar, { { 0, 0 }, 0.0 });
+    std::vector<int> vrefine;
+
+    rpose = { { 0, 0 }, 0.0, 1.0, 0.0 };
+
+    // calculate full resolution image gradients just once for all variants
+    Sobel(rsrc, grad_x, CV_32F, 1, 0, ksize);
+    Sobel(rsrc, grad_y, CV_32F, 0, 1, ksize);
+
+    // coarse search only works if every variant has a reduced-resolution template
+    bool is_coarse = true;
+    for (const auto& r : vvariants)
+    {
+        is_coarse = is_coarse && (!r.matcher.get_pyramid().empty());
+    }
+
+    if (is_coarse)
+    {
+        // calculate half resolution image gradients just once for all variants
+        cv::pyrDown(rsrc, src_half);
+        Sobel(src_half, grad_half_x, CV_32F, 1, 0, ksize);
+        Sobel(src_half, grad_half_y, CV_32F, 0, 1, ksize);
+
+        // match every variant at half resolution
+        cv::parallel_for_(cv::Range(0, nvar), [&](const cv::Range& r)
+        {
+            for (int i = r.start; i < r.end; i++)
+            {
+                const TOGMatcher& rcoarse = vvariants[i].matcher.get_pyramid()[0];
+                if (is_template_fit(rcoarse, src_half.size()))
+                {
+                    cv::Mat tmatch;
+                    rcoarse.perform_match_grad(grad_half_x, grad_half_y, tmatch, is_mask_enabled);
+                    find_best_match(tmatch, vcoarse[i]);
+                }
+            }
+        });
+
+        // reject variants that are much worse than the best one
+        // and keep only a few of the best
+        double qbest = 0.0;
+        for (const auto& r : vcoarse)
+        {
+            qbest = std::max(qbest, r.score);
+        }
+        for (int i = 0; i < nvar; i++)
+        {
+            if ((vcoarse[i].score > 0.0) && (vcoarse[i].score >= (qbest * TOG_POSE_REJECT_FRAC)))
+            {
+                vrefine.push_back(i);
+            }
+        }
+        std::sort(vrefine.begin(), vrefine.end(), [&](const int a, const int b)
+        {
+            return vcoarse[a].score > vcoarse[b].score;
+        });
+        if (vrefine.size() > TOG_POSE_MAX_REFINE)
+        {
+            vrefine.resize(TOG_POSE_MAX_REFINE);
+        }
+    }
+    else
+    {
+        // no coarse search so every variant gets a full search
+        for (int i = 0; i < nvar; i++)
+        {
+            vrefine.push_back(i);
+        }
+    }
+
+    // match the surviving variants at full resolution
+    cv::parallel_for_(cv::Range(0, static_cast<int>(vrefine.size())), [&](const cv::Range& r)
+    {
+        for (int k = r.start; k < r.end; k++)
+        {
+            const int i = vrefine[k];
+            const TOGMatcher& rfine = vvariants[i].matcher;
+            const cv::Size tsize = rfine.get_template_dx().size();
+            cv::Rect roi({ 0, 0 }, rsrc.size());
+
+            if (is_coarse)
+            {
+                // map coarse peak to a small search window at full resolution
+                const TOGMatcher& rcoarse = rfine.get_pyramid()[0];
+                const cv::Point ptfine = ((vcoarse[i].pt + rcoarse.get_template_offset()) * 2) - rfine.get_template_offset();
+                const int rad = TOG_PYR_SEARCH_RADIUS;
+                roi = cv::Rect(ptfine.x - rad, ptfine.y - rad, tsize.width + (2 * rad), tsize.height + (2 * rad));
+                roi &= cv::Rect({ 0, 0 }, rsrc.size());
+            }
+
+            if ((roi.width >= tsize.width) && (roi.height >= tsize.height))
+            {
+                cv::Mat tmatch;
+                rfine.perform_match_grad(grad_x(roi), grad_y(roi), tmatch, is_mask_enabled);
+                find_best_match(tmatch, vfine[i]);
+                vfine[i].pt += roi.tl() + rfine.get_template_offset();
+            }
+        }
+    });
+
+    // pick the best of the full resolution matches
+    bool result = false;
+    for (const int i : vrefine)
+    {
+        if (vfine[i].score > rpose.score)
+        {
+            rpose = { vfine[i].pt, vvariants[i].angle, vvariants[i].scale, vfine[i].score };
+            result = true;
+        }
+    }
+    return result;
+}
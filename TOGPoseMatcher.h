@@ -0,0 +1,117 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef TOG_POSE_MATCHER_H_
+#define TOG_POSE_MATCHER_H_
+
+#include <vector>
+#include "opencv2/imgproc.hpp"
+#include "TOGMatcher.h"
+
+
+// Default step (degrees) between rotated variants of the template
+#define TOG_POSE_DEFAULT_ANGLE_STEP     (10.0)
+
+// Default step between scaled variants of the template
+#define TOG_POSE_DEFAULT_SCALE_STEP     (0.1)
+
+// Variants with a coarse score below this fraction of the best coarse score are rejected
+#define TOG_POSE_REJECT_FRAC            (0.8)
+
+// Maximum number of variants that survive the coarse search and are refined at full resolution
+#define TOG_POSE_MAX_REFINE             (4)
+
+
+// Matches rotated and scaled variants of a template.
+// The variants are made by rotating and scaling the template gradient images
+// and rotating each gradient vector, so Sobel is only run once on the template.
+// All variants are matched in parallel at half resolution first.  Then only the
+// best few variants are matched at full resolution in a small window around
+// their coarse peaks.  So adding more variants mostly adds to the coarse search
+// which costs about 1/16 of a full resolution search per variant.
+class TOGPoseMatcher
+{
+public:
+
+    // position, rotation, and scale of a match
+    typedef struct
+    {
+        cv::Point pt;       // location of template center in image
+        double angle;       // rotation in degrees (counter-clockwise)
+        double scale;       // scale factor
+        double score;       // match score
+    } pose_info_t;
+
+    // one rotated and scaled template
+    typedef struct
+    {
+        double angle;
+        double scale;
+        TOGMatcher matcher;
+    } variant_t;
+
+    TOGPoseMatcher();
+    virtual ~TOGPoseMatcher();
+
+    // clears all variants and sets Sobel kernel size and magnitude threshold
+    void init(
+        const int ksize = TOG_DEFAULT_KSIZE,
+        const double mag_thr = TOG_DEFAULT_MAG_THR);
+
+    void create_variants_from_file(
+        const char * s,
+        const double angle_step = TOG_POSE_DEFAULT_ANGLE_STEP,
+        const double scale_min = 1.0,
+        const double scale_max = 1.0,
+        const double scale_step = TOG_POSE_DEFAULT_SCALE_STEP);
+
+    // creates variants for every angle in 0-360 degrees and every scale in the range
+    void create_variants_from_img(
+        const cv::Mat& rsrc,
+        const double angle_step = TOG_POSE_DEFAULT_ANGLE_STEP,
+        const double scale_min = 1.0,
+        const double scale_max = 1.0,
+        const double scale_step = TOG_POSE_DEFAULT_SCALE_STEP);
+
+    // finds best match over all variants
+    // returns false if no variant could be matched
+    bool perform_match(
+        const cv::Mat& rsrc,
+        pose_info_t& rpose,
+        const bool is_mask_enabled = true) const;
+
+    size_t size(void) const { return vvariants.size(); }
+    const variant_t& get_variant(const size_t i) const { return vvariants[i]; }
+
+private:
+
+    // Sobel kernel size for all templates and image gradients
+    int ksize;
+
+    // Magnitude threshold for all templates
+    double mag_thr;
+
+    // One matcher for each rotation and scale
+    std::vector<variant_t> vvariants;
+};
+
+#endif // TOG_POSE_MATCHER_H_
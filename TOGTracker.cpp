@@ -0,0 +1,153 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#include <cmath>
+#include "TOGTracker.h"
+
+
+TOGTracker::TOGTracker() :
+    score_thr(TOG_TRACK_DEFAULT_THR),
+    search_radius(TOG_TRACK_DEFAULT_RADIUS),
+    full_search_period(TOG_TRACK_DEFAULT_PERIOD),
+    frame_ct(0),
+    is_locked(false),
+    pos(0.0, 0.0),
+    vel(0.0, 0.0),
+    search_roi(0, 0, 0, 0),
+    buf_roi(0, 0, 0, 0)
+{
+}
+
+
+TOGTracker::~TOGTracker()
+{
+}
+
+
+void TOGTracker::init(const double score_thr, const int search_radius, const int full_search_period)
+{
+    this->score_thr = score_thr;
+    this->search_radius = search_radius;
+    this->full_search_period = full_search_period;
+    reset();
+}
+
+
+void TOGTracker::reset(void)
+{
+    frame_ct = 0;
+    is_locked = false;
+    pos = { 0.0, 0.0 };
+    vel = { 0.0, 0.0 };
+}
+
+
+bool TOGTracker::perform_match(
+    const TOGMatcher& rmatcher,
+    const cv::Mat& rsrc,
+    cv::Mat& rtmatch,
+    TOGMatcher::peak_info_t& rpeak,
+    const bool is_mask_enabled,
+    const int ksize)
+{
+    cv::Mat tmatch;
+    const cv::Size tsize = rmatcher.get_template_dx().size();
+    const cv::Size result_size(rsrc.cols - tsize.width + 1, rsrc.rows - tsize.height + 1);
+    const cv::Point2d pred = pos + vel;
+
+    // do a full search if not tracking or if it is time for a periodic full search
+    // otherwise search in window around predicted location
+    frame_ct++;
+    const bool is_full_search = (!is_locked) || (frame_ct >= full_search_period);
+    if (is_full_search)
+    {
+        frame_ct = 0;
+        search_roi = cv::Rect({ 0, 0 }, rsrc.size());
+    }
+    else
+    {
+        // window grows with speed of object
+        const int rad = search_radius + static_cast<int>(std::ceil(std::abs(vel.x) + std::abs(vel.y)));
+        const cv::Point ptpred(cvRound(pred.x), cvRound(pred.y));
+        search_roi = cv::Rect(ptpred.x - rad, ptpred.y - rad, tsize.width + (2 * rad), tsize.height + (2 * rad));
+        search_roi &= cv::Rect({ 0, 0 }, rsrc.size());
+    }
+
+    rpeak = { { 0, 0 }, 0.0 };
+    if ((search_roi.width >= tsize.width) && (search_roi.height >= tsize.height))
+    {
+        // gradients of the window use the image pixels just outside it
+        // so the window results are the same as for a full image search
+        rmatcher.perform_match(rsrc(search_roi), tmatch, is_mask_enabled, ksize);
+
+        // masked matches can have invalid values in flat regions of the image
+        TOGMatcher::zero_invalid_results(tmatch);
+        cv::minMaxLoc(tmatch, nullptr, &rpeak.score, nullptr, &rpeak.pt);
+        rpeak.pt += search_roi.tl();
+    }
+
+    // place window result in full size result
+    if (is_full_search)
+    {
+        rtmatch = tmatch;
+    }
+    else
+    {
+        // full size result is kept between frames so it is only cleared once
+        // then only the old window is cleared if the window moves
+        const cv::Rect roi(search_roi.tl(), tmatch.size());
+        if ((tmatch_buf.size() != result_size) || (tmatch_buf.type() != CV_32F))
+        {
+            tmatch_buf = cv::Mat::zeros(result_size, CV_32F);
+            buf_roi = cv::Rect(0, 0, 0, 0);
+        }
+        if (buf_roi != roi)
+        {
+            tmatch_buf(buf_roi).setTo(0.0);
+        }
+        tmatch.copyTo(tmatch_buf(roi));
+        buf_roi = roi;
+        rtmatch = tmatch_buf;
+    }
+
+    // update track with new measurement
+    if (rpeak.score >= score_thr)
+    {
+        const cv::Point2d meas(rpeak.pt.x, rpeak.pt.y);
+        if (is_locked)
+        {
+            vel += (meas - pred) * TOG_TRACK_VEL_GAIN;
+        }
+        else
+        {
+            vel = { 0.0, 0.0 };
+        }
+        pos = meas;
+        is_locked = true;
+    }
+    else
+    {
+        reset();
+    }
+
+    return is_locked;
+}
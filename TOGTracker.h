@@ -0,0 +1,110 @@
+// MIT License
+//
+// Copyright(c) 2021 Mark Whitney
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+
+#ifndef TOG_TRACKER_H_
+#define TOG_TRACKER_H_
+
+#include "opencv2/imgproc.hpp"
+#include "TOGMatcher.h"
+
+
+// Minimum match score for a detection to start or continue a track
+#define TOG_TRACK_DEFAULT_THR       (0.5)
+
+// Half-size (in pixels) of search window around predicted location
+#define TOG_TRACK_DEFAULT_RADIUS    (16)
+
+// A full image search is done at least this often (in frames) while tracking
+#define TOG_TRACK_DEFAULT_PERIOD    (30)
+
+// Gain for correcting velocity estimate with prediction error (0.0-1.0)
+#define TOG_TRACK_VEL_GAIN          (0.5)
+
+
+// Tracks a template match from frame to frame.
+// After a confident detection, the next location is predicted with a
+// constant-velocity (alpha-beta) model and the template is only matched in a
+// small window around the prediction.  A full image search is done when the
+// track is lost or periodically to catch a better match elsewhere.
+class TOGTracker
+{
+public:
+
+    TOGTracker();
+    virtual ~TOGTracker();
+
+    void init(
+        const double score_thr = TOG_TRACK_DEFAULT_THR,
+        const int search_radius = TOG_TRACK_DEFAULT_RADIUS,
+        const int full_search_period = TOG_TRACK_DEFAULT_PERIOD);
+
+    // drops current track so next match is a full image search
+    // this must be called whenever the template changes
+    void reset(void);
+
+    // matches template in search window around predicted location (or in full image)
+    // match result is the same size as a full image match but it is zero outside the window
+    // (when a window is searched the result is a buffer owned by the tracker that is reused
+    // on the next frame so it must not be modified, copy it first if it will be changed)
+    // best match is returned in rpeak and function returns true if object is being tracked
+    bool perform_match(
+        const TOGMatcher& rmatcher,
+        const cv::Mat& rsrc,
+        cv::Mat& rtmatch,
+        TOGMatcher::peak_info_t& rpeak,
+        const bool is_mask_enabled = true,
+        const int ksize = TOG_DEFAULT_KSIZE);
+
+    bool is_tracking(void) const { return is_locked; }
+    const cv::Rect& get_search_roi(void) const { return search_roi; }
+    const cv::Point2d& get_velocity(void) const { return vel; }
+
+private:
+
+    // Minimum match score for a detection
+    double score_thr;
+
+    // Half-size of search window
+    int search_radius;
+
+    // Frames between full image searches
+    int full_search_period;
+
+    // Frames since last full image search
+    int frame_ct;
+
+    // Flag for object being tracked
+    bool is_locked;
+
+    // Estimated location (in match result coordinates) and velocity (pixels per frame)
+    cv::Point2d pos;
+    cv::Point2d vel;
+
+    // Search window in image for most recent match
+    cv::Rect search_roi;
+
+    // Full size match result for window searches and region of last window result in it
+    cv::Mat tmatch_buf;
+    cv::Rect buf_roi;
+};
+
+#endif // TOG_TRACKER_H_
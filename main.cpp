@@ -25,6 +25,7 @@
 #include "opencv2/highgui.hpp"
 #include "opencv2/videoio.hpp"
 
+#include <cstdio>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -34,6 +35,10 @@
 #include "PatternRec.h"
 #include "BGRLandmark.h"
 #include "TOGMatcher.h"
+#include "TOGLibrary.h"
+#include "TOGBatchMatcher.h"
+#include "TOGTracker.h"
+#include "TOGPoseMatcher.h"
 #include "Knobs.h"
 #include "util.h"
 
@@ -42,6 +47,7 @@
 #define CALIB_PATH              ".\\calib\\"    // user may need to create or change this
 #define MOVIE_PATH              ".\\movie\\"    // user may need to create or change this
 #define DATA_PATH               ".\\data\\"     // user may need to change this
+#define TEMPLATE_LIB_NAME       "templates.togl"    // compiled templates in DATA_PATH
 
 
 using namespace cv;
@@ -81,6 +87,10 @@ const std::vector<T_file_info> vfiles =
 
 size_t nfile = 0U;
 
+// compiled templates for every file and every Sobel kernel size in Knobs
+TOGLibrary theTemplateLib;
+const std::vector<int> vlibksize = { -1, 1, 3, 5, 7 };
+
 
 
 bool check_order(
@@ -207,6 +217,40 @@ void image_output(
 
 
 
+void init_template_library(void)
+{
+    std::string slib = std::string(DATA_PATH) + TEMPLATE_LIB_NAME;
+    if (theTemplateLib.load(slib))
+    {
+        std::cout << "Loaded template library: " << theTemplateLib.size() << " templates" << std::endl;
+    }
+
+    // compile any template that is missing (or no library yet or old version)
+    // or whose image file or magnitude threshold has changed
+    size_t ncompiled = 0U;
+    for (const auto& rinfo : vfiles)
+    {
+        std::string spath = DATA_PATH + rinfo.sname;
+        for (const auto& k : vlibksize)
+        {
+            if (theTemplateLib.update_template_from_file(rinfo.sname, spath, k, rinfo.mag_thr))
+            {
+                ncompiled++;
+            }
+        }
+    }
+
+    // then save library if anything changed
+    if (ncompiled > 0U)
+    {
+        std::cout << "Updating template library: " << ncompiled << " templates compiled" << std::endl;
+        bool is_ok = theTemplateLib.save(slib);
+        std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+    }
+}
+
+
+
 void reload_template(TOGMatcher& rtogm, const T_file_info& rinfo, const int ksize)
 {
     const char * sxymtitle = "DX, DY, and Mask";
@@ -222,8 +266,12 @@ void reload_template(TOGMatcher& rtogm, const T_file_info& rinfo, const int ksiz
     // clear the window
     imshow(sxymtitle, tdxdym);
     
+    // use compiled template if it is in library
     std::cout << "Loading template (size= " << ksize << "): " << rinfo.sname << std::endl;
-    rtogm.create_template_from_file(spath.c_str(), ksize, rinfo.mag_thr);
+    if (!theTemplateLib.get_template(rinfo.sname, ksize, rinfo.mag_thr, rtogm))
+    {
+        rtogm.create_template_from_file(spath.c_str(), ksize, rinfo.mag_thr);
+    }
 
     // convert copies of template images into formats suitable for display
     rtogm.get_template_dx().convertTo(tdx, CV_8S);
@@ -672,6 +720,7 @@ void loop(void)
     Mat tmatch;
    
     TOGMatcher togm;
+    TOGTracker togt;
     Ptr<CLAHE> pCLAHE = createCLAHE();
 
     // need a 0 as argument
@@ -693,6 +742,7 @@ void loop(void)
     theKnobs.handle_keypress('0');
 
     // initialize template
+    init_template_library();
     reload_template(togm, vfiles[nfile], theKnobs.get_ksize());
 
     // and the image processing loop is running...
@@ -713,6 +763,7 @@ void loop(void)
                     nfile = (nfile + 1) % vfiles.size();
                 }
                 reload_template(togm, vfiles[nfile], theKnobs.get_ksize());
+                togt.reset();
             }
             else if (op_id == Knobs::OP_RECORD)
             {
@@ -780,8 +831,26 @@ void loop(void)
         }
 
         // perform template match and locate maximum (best match)
-        togm.perform_match(img_gray, tmatch, theKnobs.get_mask_enabled(), theKnobs.get_ksize());
-        minMaxLoc(tmatch, nullptr, &qmax, nullptr, &ptmax);
+        if (theKnobs.get_tracking_enabled())
+        {
+            TOGMatcher::peak_info_t peak;
+            togt.perform_match(togm, img_gray, tmatch, peak, theKnobs.get_mask_enabled(), theKnobs.get_ksize());
+            qmax = peak.score;
+            ptmax = peak.pt;
+        }
+        else
+        {
+            if (theKnobs.get_pyramid_enabled())
+            {
+                togm.perform_match_pyramid(img_gray, tmatch, theKnobs.get_mask_enabled(), theKnobs.get_ksize());
+            }
+            else
+            {
+                togm.perform_match(img_gray, tmatch, theKnobs.get_mask_enabled(), theKnobs.get_ksize());
+            }
+            minMaxLoc(tmatch, nullptr, &qmax, nullptr, &ptmax);
+            togt.reset();
+        }
 
         // apply the current output mode
         // content varies but all final output images are BGR
@@ -797,10 +866,10 @@ void loop(void)
             {
                 // show the raw template match result
                 // it is shifted and placed on top of blank image of original input size
+                // (tracker owns its match result so it is normalized into another image)
                 Mat full_tmatch = Mat::zeros(img_gray.size(), CV_32F);
                 Rect roi = Rect(togm.get_template_offset(), tmatch.size());
-                normalize(tmatch, tmatch, 0, 1, cv::NORM_MINMAX);
-                tmatch.copyTo(full_tmatch(roi));
+                normalize(tmatch, full_tmatch(roi), 0, 1, cv::NORM_MINMAX);
                 cvtColor(full_tmatch, img_viewer, COLOR_GRAY2BGR);
                 max_mode = max_mode_t::RECT;
                 break;
@@ -810,11 +879,12 @@ void loop(void)
                 // display pre-processed gray input image
                 // show red overlay of any matches that exceed arbitrary threshold
                 Mat match_mask;
+                Mat tmatch_norm;
                 std::vector<std::vector<cv::Point>> contours;
                 const Point& tmpl_offset = togm.get_template_offset();
                 cvtColor(img_gray, img_viewer, COLOR_GRAY2BGR);
-                normalize(tmatch, tmatch, 0, 1, cv::NORM_MINMAX);
-                match_mask = (tmatch > MATCH_DISPLAY_THRESHOLD);
+                normalize(tmatch, tmatch_norm, 0, 1, cv::NORM_MINMAX);
+                match_mask = (tmatch_norm > MATCH_DISPLAY_THRESHOLD);
                 findContours(match_mask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
                 drawContours(img_viewer, contours, -1, SCA_RED, -1, LINE_8, noArray(), INT_MAX, tmpl_offset);
                 max_mode = max_mode_t::RECT;
@@ -996,6 +1066,1072 @@ void test_patt_rec()
 
 
 
+bool report_match_diff(const char * sname, const Mat& rref, const Mat& rtest, const double tol)
+{
+    // compare a match result with a reference result
+    // ignore garbage values (NaN, Inf) that OpenCV can produce in flat image regions
+    // a negative tolerance means only the max locations have to agree
+    double qmax;
+    double qdiff;
+    Point ptmax;
+    Point ptmax_ref;
+    Mat diff;
+    Mat valid_mask = (abs(rref) <= 1.0);
+    minMaxLoc(rtest, nullptr, &qmax, nullptr, &ptmax);
+    minMaxLoc(rref, nullptr, nullptr, nullptr, &ptmax_ref, valid_mask);
+    absdiff(rref, rtest, diff);
+    minMaxLoc(diff, nullptr, &qdiff, nullptr, nullptr, valid_mask);
+    bool is_ok = (tol < 0.0) ? (ptmax == ptmax_ref) : (qdiff <= tol);
+    std::cout << "  " << sname << " max=" << qmax << " at " << ptmax << " diff=" << qdiff << " ";
+    std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+    return is_ok;
+}
+
+
+
+float quant_score_ref(
+    const TOGMatcher& rtogm,
+    const Mat& rgrad_x,
+    const Mat& rgrad_y,
+    const float mag2_min,
+    const Point& rpt)
+{
+    // straightforward quantized match score at one location
+    // each feature looks for its orientation (4) or an adjacent one (1) near its image pixel
+    const auto& rvquant = rtogm.get_quant_features();
+    int sum = 0;
+    for (const auto& r : rvquant)
+    {
+        int best = 0;
+        for (int j = -TOG_QUANT_SPREAD; j <= TOG_QUANT_SPREAD; j++)
+        {
+            for (int i = -TOG_QUANT_SPREAD; i <= TOG_QUANT_SPREAD; i++)
+            {
+                const Point pt = rpt + r.pt + Point(i, j);
+                if (Rect({ 0, 0 }, rgrad_x.size()).contains(pt))
+                {
+                    const float dx = rgrad_x.at<float>(pt);
+                    const float dy = rgrad_y.at<float>(pt);
+                    if (((dx * dx) + (dy * dy)) > mag2_min)
+                    {
+                        const int ori = static_cast<int>((fastAtan2(dy, dx) / 45.0f) + 0.5f) & 7;
+                        const int d = (ori - r.ori) & 7;
+                        best = std::max(best, (d == 0) ? 4 : (((d == 1) || (d == 7)) ? 1 : 0));
+                    }
+                }
+            }
+        }
+        sum += best;
+    }
+    const float fscale = (rvquant.empty()) ? 0.0f : (1.0f / (4.0f * rvquant.size()));
+    return sum * fscale;
+}
+
+
+
+void test_tog_engines()
+{
+    // run the alternate TOGMatcher engines on a test image with each template
+    // and compare against the standard spatial match
+    // exact engines only differ by float round-off
+    const double MATCH_TOL = 1.0e-4;
+    TOGMatcher togm;
+    TOGMatchWorkspace ws;
+    Mat img;
+    Mat tmatch_ref;
+    Mat tmatch;
+
+    std::string simg = DATA_PATH;
+    simg += "bottle_100perc_b_on_w.png";
+    img = imread(simg, IMREAD_GRAYSCALE);
+
+    // low-rank factoring is off by default
+    togm.set_lowrank_params();
+
+    for (const auto& rinfo : vfiles)
+    {
+        std::string spath = DATA_PATH + rinfo.sname;
+        togm.create_template_from_file(spath.c_str(), TOG_DEFAULT_KSIZE, rinfo.mag_thr);
+
+        for (const bool is_mask_enabled : { false, true })
+        {
+            std::cout << rinfo.sname << " Mask=" << is_mask_enabled << std::endl;
+            togm.perform_match(img, tmatch_ref, is_mask_enabled);
+
+            togm.perform_match(img, tmatch, ws, is_mask_enabled);
+            report_match_diff("Wkspace", tmatch_ref, tmatch, MATCH_TOL);
+
+            togm.perform_match_dft(img, tmatch, is_mask_enabled);
+            report_match_diff("DFT    ", tmatch_ref, tmatch, MATCH_TOL);
+
+            togm.perform_match_fused(img, tmatch, is_mask_enabled);
+            report_match_diff("Fused  ", tmatch_ref, tmatch, MATCH_TOL);
+
+            togm.perform_match_sparse(img, tmatch, is_mask_enabled);
+            report_match_diff("Sparse ", tmatch_ref, tmatch, MATCH_TOL);
+
+            togm.perform_match_integral(img, tmatch, is_mask_enabled);
+            report_match_diff("Integ  ", tmatch_ref, tmatch, MATCH_TOL);
+
+            // low-rank result is only as good as the approximation
+            // so just check that the max location agrees
+            togm.perform_match_lowrank(img, tmatch, is_mask_enabled);
+            report_match_diff("LowRank", tmatch_ref, tmatch, -1.0);
+            std::cout << "    rank=" << togm.get_lowrank_template(is_mask_enabled, 0).vcol.size();
+            std::cout << "," << togm.get_lowrank_template(is_mask_enabled, 1).vcol.size();
+            std::cout << " err=" << togm.get_lowrank_template(is_mask_enabled, 0).err;
+            std::cout << "," << togm.get_lowrank_template(is_mask_enabled, 1).err;
+            std::cout << " speedup=" << togm.get_lowrank_speedup(is_mask_enabled) << std::endl;
+
+            togm.set_gradient_depth(CV_16S);
+            togm.perform_match(img, tmatch, is_mask_enabled);
+            togm.set_gradient_depth(CV_32F);
+            report_match_diff("Int16  ", tmatch_ref, tmatch, MATCH_TOL);
+
+            // thresholded SQDIFF only has exact errors below the threshold
+            // so set the threshold a little above the best error and check the best location
+            {
+                Mat tmatch_sq;
+                double qmax_ref;
+                double qmax;
+                Point ptmax_ref;
+                Point ptmax;
+                togm.perform_match_sqdiff(img, tmatch_sq, is_mask_enabled, TOG_DEFAULT_KSIZE);
+                minMaxLoc(tmatch_sq, nullptr, &qmax_ref, nullptr, &ptmax_ref);
+                togm.perform_match_sqdiff_thr(img, tmatch, -qmax_ref * 1.1 + 1.0, is_mask_enabled, TOG_DEFAULT_KSIZE, true);
+                minMaxLoc(tmatch, nullptr, &qmax, nullptr, &ptmax);
+                bool is_ok = (ptmax == ptmax_ref);
+                std::cout << "  SqdThr  max=" << qmax << " at " << ptmax << " ref=" << qmax_ref << " at " << ptmax_ref << " ";
+                std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+            }
+
+            // pyramid result is only filled in near the best candidates
+            // so just check that the max location agrees
+            togm.perform_match_pyramid(img, tmatch, is_mask_enabled);
+            report_match_diff("Pyramid", tmatch_ref, tmatch, -1.0);
+
+            // calibrated engine must give same result as reference
+            // engines are calibrated with just the image size like when a template is loaded
+            togm.calibrate_engines(img.size(), is_mask_enabled);
+            togm.perform_match_auto(img, tmatch, is_mask_enabled);
+            report_match_diff("Auto   ", tmatch_ref, tmatch, MATCH_TOL);
+            std::cout << "    engine=" << TOGMatcher::get_engine_name(togm.get_engine()) << " msec=";
+            for (size_t i = 0; i < togm.get_engine_timings().size(); i++)
+            {
+                std::cout << ((i) ? "," : "") << togm.get_engine_timings()[i];
+            }
+            std::cout << std::endl;
+
+            // complex scores are on a different scale
+            // so just check that the max location agrees
+            togm.perform_match_complex(img, tmatch, is_mask_enabled);
+            report_match_diff("Complex", tmatch_ref, tmatch, -1.0);
+
+            // quantized scores are on a different scale and do not depend on mask
+            // so check that the max location agrees with the masked match
+            // then check scores at the max and on a grid against a straightforward reference
+            if (is_mask_enabled)
+            {
+                Mat grad_x;
+                Mat grad_y;
+                double qdiff = 0.0;
+                Point ptmax;
+                togm.perform_match_quant(img, tmatch);
+                report_match_diff("Quant  ", tmatch_ref, tmatch, -1.0);
+                Sobel(img, grad_x, CV_32F, 1, 0, TOG_DEFAULT_KSIZE);
+                Sobel(img, grad_y, CV_32F, 0, 1, TOG_DEFAULT_KSIZE);
+                const double mag_min = TOG_DEFAULT_QUANT_MAG_FRAC * togm.get_quant_mag_max();
+                const float mag2_min = static_cast<float>(mag_min * mag_min);
+                minMaxLoc(tmatch, nullptr, nullptr, nullptr, &ptmax);
+                std::vector<Point> vpts = { ptmax };
+                for (int y = 0; y < tmatch.rows; y += 37)
+                {
+                    for (int x = 0; x < tmatch.cols; x += 37)
+                    {
+                        vpts.push_back({ x, y });
+                    }
+                }
+                for (const auto& rpt : vpts)
+                {
+                    const float q = quant_score_ref(togm, grad_x, grad_y, mag2_min, rpt);
+                    qdiff = std::max(qdiff, static_cast<double>(std::fabs(tmatch.at<float>(rpt) - q)));
+                }
+                bool is_ok = (qdiff == 0.0);
+                std::cout << "  QuantRef diff=" << qdiff << " ";
+                std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+            }
+        }
+    }
+}
+
+
+
+// Mat allocator that counts allocations then passes them to the standard allocator
+class CountingMatAllocator : public cv::MatAllocator
+{
+public:
+
+    CountingMatAllocator() : ct(0) {}
+
+    cv::UMatData* allocate(
+        int dims, const int* sizes, int type, void* data, size_t* step,
+        cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const
+    {
+        ct++;
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessflags, cv::UMatUsageFlags usageFlags) const
+    {
+        return cv::Mat::getStdAllocator()->allocate(data, accessflags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData* data) const
+    {
+        cv::Mat::getStdAllocator()->deallocate(data);
+    }
+
+    mutable int ct;
+};
+
+
+
+// greedy NMS over every local max in a match result (reference for find_peaks)
+// uses same local max rule as find_peaks (plateau gives the first pixel in raster order)
+void find_peaks_greedy(
+    const Mat& rtmatch,
+    const int k,
+    const double thr,
+    const Size& rnms_size,
+    std::vector<TOGMatcher::peak_info_t>& rvpeaks)
+{
+    std::vector<TOGMatcher::peak_info_t> vall;
+    for (int y = 0; y < rtmatch.rows; y++)
+    {
+        for (int x = 0; x < rtmatch.cols; x++)
+        {
+            const float q = rtmatch.at<float>(y, x);
+            bool is_max = (q >= thr) && (q <= 1.01f) && (q > 0.0f);
+            for (int dy = -1; is_max && (dy <= 1); dy++)
+            {
+                for (int dx = -1; is_max && (dx <= 1); dx++)
+                {
+                    const Point pt(x + dx, y + dy);
+                    if (((dx != 0) || (dy != 0)) && Rect({ 0, 0 }, rtmatch.size()).contains(pt))
+                    {
+                        const bool is_earlier = (dy < 0) || ((dy == 0) && (dx < 0));
+                        const float qn = rtmatch.at<float>(pt);
+                        is_max = (is_earlier) ? (qn < q) : (qn <= q);
+                    }
+                }
+            }
+            if (is_max)
+            {
+                vall.push_back({ { x, y }, q, { static_cast<float>(x), static_cast<float>(y) } });
+            }
+        }
+    }
+
+    std::stable_sort(vall.begin(), vall.end(),
+        [](const TOGMatcher::peak_info_t& a, const TOGMatcher::peak_info_t& b) { return a.score > b.score; });
+    rvpeaks.clear();
+    for (const auto& rc : vall)
+    {
+        bool is_suppressed = false;
+        for (const auto& rp : rvpeaks)
+        {
+            is_suppressed = is_suppressed ||
+                ((std::abs(rp.pt.x - rc.pt.x) <= rnms_size.width / 2) && (std::abs(rp.pt.y - rc.pt.y) <= rnms_size.height / 2));
+        }
+        if (!is_suppressed && (static_cast<int>(rvpeaks.size()) < k))
+        {
+            rvpeaks.push_back(rc);
+        }
+    }
+}
+
+
+
+void test_tog_find_peaks()
+{
+    // make a match result with dozens of identical parts
+    // each one is a peak with a ring of side lobes that has many local maxima
+    // then check that find_peaks gives same peaks as greedy NMS over all local maxima
+    const Size nms_size(21, 21);
+    const int nparts = 48;
+    Mat tmatch(480, 640, CV_32F);
+    RNG rng(0);
+    rng.fill(tmatch, RNG::UNIFORM, 0.0, 0.05);
+    for (int i = 0; i < nparts; i++)
+    {
+        const Point ctr(40 + (i % 8) * 80, 40 + (i / 8) * 80);
+        const double s = 0.5 + (0.01 * rng.uniform(0.0, 40.0));
+        for (int y = -9; y <= 9; y++)
+        {
+            for (int x = -9; x <= 9; x++)
+            {
+                const double r = std::sqrt(x * x + y * y);
+                const double lobe = 0.9 * std::exp(-0.5 * (r - 6.0) * (r - 6.0)) * (1.0 + rng.uniform(-0.05, 0.05));
+                const double core = std::exp(-0.5 * r * r);
+                tmatch.at<float>(ctr + Point(x, y)) += static_cast<float>(s * std::max(lobe, core));
+            }
+        }
+    }
+
+    // quantized copy has plateaus and many peaks with equal scores
+    Mat tmatch_quant;
+    tmatch.convertTo(tmatch_quant, CV_32S, 32.0);
+    tmatch_quant.convertTo(tmatch_quant, CV_32F, 1.0 / 32.0);
+
+    for (const auto& rtmatch : { tmatch, tmatch_quant })
+    {
+        for (const int k : { 1, 8, 24, nparts, nparts * 2 })
+        {
+            std::vector<TOGMatcher::peak_info_t> vpeaks;
+            std::vector<TOGMatcher::peak_info_t> vref;
+            TOGMatcher::find_peaks(rtmatch, k, 0.2, nms_size, vpeaks);
+            find_peaks_greedy(rtmatch, k, 0.2, nms_size, vref);
+
+            bool is_ok = (vpeaks.size() == vref.size());
+            for (size_t i = 0; is_ok && (i < vpeaks.size()); i++)
+            {
+                is_ok = (vpeaks[i].pt == vref[i].pt) && (vpeaks[i].score == vref[i].score);
+            }
+            std::cout << "K=" << k << " peaks=" << vpeaks.size() << "," << vref.size() << " ";
+            std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+        }
+    }
+}
+
+
+
+void test_tog_workspace()
+{
+    // match same image several times with a workspace
+    // and check that nothing is allocated after the first frame
+    TOGMatcher togm;
+    TOGMatchWorkspace ws;
+    CountingMatAllocator counter;
+    Mat img;
+    Mat tmatch_ref;
+    Mat tmatch;
+    Mat tmatch_sq;
+
+    std::string simg = DATA_PATH;
+    simg += "bottle_100perc_b_on_w.png";
+    img = imread(simg, IMREAD_GRAYSCALE);
+
+    for (const auto& rinfo : vfiles)
+    {
+        std::string spath = DATA_PATH + rinfo.sname;
+        togm.create_template_from_file(spath.c_str(), TOG_DEFAULT_KSIZE, rinfo.mag_thr);
+
+        for (const bool is_mask_enabled : { false, true })
+        {
+            std::cout << rinfo.sname << " Mask=" << is_mask_enabled << std::endl;
+            togm.perform_match(img, tmatch_ref, is_mask_enabled);
+
+            // first frame sizes the workspace and outputs
+            togm.perform_match(img, tmatch, ws, is_mask_enabled);
+            togm.perform_match_sqdiff(img, tmatch_sq, ws, is_mask_enabled);
+            report_match_diff("Workspace", tmatch_ref, tmatch, 1.0e-4);
+
+            cv::MatAllocator * pstd = cv::Mat::getDefaultAllocator();
+            cv::Mat::setDefaultAllocator(&counter);
+            counter.ct = 0;
+            for (int n = 0; n < 10; n++)
+            {
+                togm.perform_match(img, tmatch, ws, is_mask_enabled);
+                togm.perform_match_sqdiff(img, tmatch_sq, ws, is_mask_enabled);
+            }
+            cv::Mat::setDefaultAllocator(pstd);
+
+            bool is_ok = (counter.ct == 0);
+            std::cout << "  Allocations=" << counter.ct << " ";
+            std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+
+            // workspace match should take about the same time as the standard match
+            int64 t0 = getTickCount();
+            for (int n = 0; n < 10; n++)
+            {
+                togm.perform_match(img, tmatch, ws, is_mask_enabled);
+            }
+            int64 t1 = getTickCount();
+            for (int n = 0; n < 10; n++)
+            {
+                togm.perform_match(img, tmatch_ref, is_mask_enabled);
+            }
+            int64 t2 = getTickCount();
+            const double msec_ws = 100.0 * static_cast<double>(t1 - t0) / getTickFrequency();
+            const double msec_ref = 100.0 * static_cast<double>(t2 - t1) / getTickFrequency();
+            is_ok = (msec_ws < (2.0 * msec_ref));
+            std::cout << "  Workspace msec=" << msec_ws << " ref msec=" << msec_ref << " ";
+            std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+
+            // tiled match must agree with the standard match
+            // and its best match must be the first max of its result like minMaxLoc
+            TOGMatcher::peak_info_t peak;
+            double qmax;
+            Point ptmax;
+            Mat tmatch_tiled;
+            Mat tmatch_tiled_first;
+            // short tiles have a short last tile and more overlap
+            togm.perform_match_tiled(img, tmatch_tiled, peak, is_mask_enabled, TOG_DEFAULT_KSIZE, 16);
+            report_match_diff("Tiled16", tmatch_ref, tmatch_tiled, 1.0e-4);
+            togm.perform_match_tiled(img, tmatch_tiled, peak, is_mask_enabled);
+            report_match_diff("Tiled", tmatch_ref, tmatch_tiled, 1.0e-4);
+            minMaxLoc(tmatch_tiled, nullptr, &qmax, nullptr, &ptmax);
+            is_ok = (peak.pt == ptmax) && (peak.score == qmax);
+            std::cout << "  Tiled max=" << peak.score << " at " << peak.pt << " ";
+            std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+            tmatch_tiled_first = tmatch_tiled.clone();
+
+            // tiled match with workspaces for each thread must not allocate after first frame
+            std::vector<TOGMatchWorkspace> vws;
+            togm.perform_match_tiled(img, tmatch_tiled, peak, vws, is_mask_enabled);
+            cv::Mat::setDefaultAllocator(&counter);
+            counter.ct = 0;
+            for (int n = 0; n < 10; n++)
+            {
+                togm.perform_match_tiled(img, tmatch_tiled, peak, vws, is_mask_enabled);
+            }
+            cv::Mat::setDefaultAllocator(pstd);
+            is_ok = (counter.ct == 0) && (cv::norm(tmatch_tiled_first, tmatch_tiled, NORM_INF) == 0.0);
+            std::cout << "  Tiled allocations=" << counter.ct << " ";
+            std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+        }
+    }
+}
+
+
+
+void test_tog_tracker()
+{
+    // move an object across a flat background at constant velocity
+    // and check tracker against a full image search on every frame
+    // the object disappears for a few frames so the track is lost and then found again
+    const int nframes = 40;
+    const int period = 8;
+    const Point2d obj_vel(6.0, 3.0);
+    const std::set<int> lost_frames = { 20, 21 };
+    TOGMatcher togm;
+    TOGTracker togt;
+    Mat obj;
+    Mat frame;
+    Mat tmatch;
+    Mat tmatch_ref;
+    Mat tmatch_out;
+    TOGMatcher::peak_info_t peak;
+
+    std::string spath = DATA_PATH;
+    spath += "bottle_20perc_b_on_w.png";
+    obj = imread(spath, IMREAD_GRAYSCALE);
+    togm.create_template_from_file(spath.c_str(), TOG_DEFAULT_KSIZE, 0.0);
+    const Size tsize = togm.get_template_dx().size();
+    togt.init(TOG_TRACK_DEFAULT_THR, TOG_TRACK_DEFAULT_RADIUS, period);
+
+    bool is_ok = true;
+    bool was_tracking = false;
+    int nwindow = 0;
+    int nsince_full = 0;
+    for (int n = 0; n < nframes; n++)
+    {
+        const bool is_lost = (lost_frames.count(n) > 0);
+        const Point ptobj(40 + cvRound(obj_vel.x * n), 60 + cvRound(obj_vel.y * n));
+        frame = Mat(480, 640, CV_8UC1, Scalar(255));
+        if (!is_lost)
+        {
+            obj.copyTo(frame(Rect(ptobj, obj.size())));
+        }
+
+        // full search is expected when there is no track or when period is up
+        const bool is_full_expected = (!was_tracking) || ((nsince_full + 1) >= period);
+        const bool is_tracking = togt.perform_match(togm, frame, tmatch, peak);
+        const bool is_full = (togt.get_search_roi() == Rect({ 0, 0 }, frame.size()));
+        nsince_full = (is_full) ? 0 : nsince_full + 1;
+
+        bool is_frame_ok = (is_full == is_full_expected) && (is_tracking == !is_lost);
+        if (!is_lost)
+        {
+            // tracker peak must be the peak of a full image search
+            // and the window must contain it
+            double qref;
+            Point ptref;
+            togm.perform_match(frame, tmatch_ref);
+            TOGMatcher::zero_invalid_results(tmatch_ref);
+            minMaxLoc(tmatch_ref, nullptr, &qref, nullptr, &ptref);
+            is_frame_ok = is_frame_ok && (peak.pt == ptref) && (std::fabs(peak.score - qref) < 1.0e-4);
+            is_frame_ok = is_frame_ok && ((togt.get_search_roi() & Rect(ptref, tsize)) == Rect(ptref, tsize));
+        }
+
+        if (!is_full)
+        {
+            // window result must be zero everywhere outside the window
+            // even after the window has moved
+            nwindow++;
+            Rect roi(togt.get_search_roi().tl(), togt.get_search_roi().size() - tsize + Size(1, 1));
+            tmatch.copyTo(tmatch_out);
+            tmatch_out(roi).setTo(0.0);
+            is_frame_ok = is_frame_ok && (countNonZero(tmatch_out) == 0);
+
+            // predicted velocity should have converged after a few frames of tracking
+            if (nsince_full > 4)
+            {
+                is_frame_ok = is_frame_ok && (cv::norm(togt.get_velocity() - obj_vel) < 0.5);
+            }
+        }
+
+        if (!is_frame_ok)
+        {
+            std::cout << "Frame " << n << " Full=" << is_full << " Tracking=" << is_tracking;
+            std::cout << " Peak=" << peak.pt << " FAILURE!" << std::endl;
+        }
+        is_ok = is_ok && is_frame_ok;
+        was_tracking = is_tracking;
+    }
+
+    // most frames should have been window searches
+    is_ok = is_ok && (nwindow > (nframes / 2));
+    std::cout << "Tracker windows=" << nwindow << "/" << nframes << " ";
+    std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+}
+
+
+
+void test_tog_pose()
+{
+    // warp a template to known poses on the variant grid and check that the pose is recovered
+    // then check that the coarse-to-fine search gives the same pose as matching
+    // every variant against the full image (coarse rejection must not drop the true pose)
+    struct T_pose { Point pt; double angle; double scale; };
+    const std::vector<T_pose> vposes =
+    {
+        { { 160, 160 },   0.0, 1.0 },
+        { { 120, 180 },  30.0, 0.8 },
+        { { 190, 140 }, 120.0, 1.2 },
+        { { 150, 170 }, 250.0, 1.0 },
+        { { 170, 150 }, 340.0, 0.8 },
+    };
+    TOGPoseMatcher togpm;
+    Mat obj;
+    Mat frame;
+    Mat tmatch;
+
+    std::string spath = DATA_PATH;
+    spath += "bottle_20perc_top_b_on_w.png";
+    obj = imread(spath, IMREAD_GRAYSCALE);
+    togpm.init();
+    togpm.create_variants_from_img(obj, TOG_POSE_DEFAULT_ANGLE_STEP, 0.8, 1.2, 0.2);
+
+    const Point2f center(0.5f * (obj.cols - 1), 0.5f * (obj.rows - 1));
+    for (const auto& rpose : vposes)
+    {
+        // put center of template at pose location
+        Mat rmat = getRotationMatrix2D(center, rpose.angle, rpose.scale);
+        rmat.at<double>(0, 2) += rpose.pt.x - center.x;
+        rmat.at<double>(1, 2) += rpose.pt.y - center.y;
+        frame = Mat(320, 320, CV_8UC1, Scalar(255));
+        warpAffine(obj, frame, rmat, frame.size(), INTER_LINEAR, BORDER_TRANSPARENT);
+
+        TOGPoseMatcher::pose_info_t pose;
+        const bool is_found = togpm.perform_match(frame, pose);
+
+        // exhaustive full resolution search over all variants
+        TOGPoseMatcher::pose_info_t pose_ref = { { 0, 0 }, 0.0, 1.0, 0.0 };
+        for (size_t i = 0; i < togpm.size(); i++)
+        {
+            const TOGPoseMatcher::variant_t& rvar = togpm.get_variant(i);
+            TOGMatcher::peak_info_t peak;
+            rvar.matcher.perform_match(frame, tmatch);
+            TOGMatcher::zero_invalid_results(tmatch);
+            minMaxLoc(tmatch, nullptr, &peak.score, nullptr, &peak.pt);
+            if (peak.score > pose_ref.score)
+            {
+                pose_ref = { peak.pt + rvar.matcher.get_template_offset(), rvar.angle, rvar.scale, peak.score };
+            }
+        }
+
+        // center of a variant may be off by a pixel because of rounding
+        const Point ptdiff = pose.pt - rpose.pt;
+        bool is_ok = is_found &&
+            (std::abs(ptdiff.x) <= 1) && (std::abs(ptdiff.y) <= 1) &&
+            (std::fabs(pose.angle - rpose.angle) < 1.0e-6) &&
+            (std::fabs(pose.scale - rpose.scale) < 1.0e-6);
+        std::cout << "Pose " << rpose.pt << " " << rpose.angle << " " << rpose.scale << " -> ";
+        std::cout << pose.pt << " " << pose.angle << " " << pose.scale << " " << pose.score << " ";
+        std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+
+        is_ok =
+            (pose.pt == pose_ref.pt) &&
+            (std::fabs(pose.angle - pose_ref.angle) < 1.0e-6) &&
+            (std::fabs(pose.scale - pose_ref.scale) < 1.0e-6) &&
+            (std::fabs(pose.score - pose_ref.score) < 1.0e-4);
+        std::cout << "  Exhaustive " << pose_ref.pt << " " << pose_ref.angle << " " << pose_ref.scale << " " << pose_ref.score << " ";
+        std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+    }
+}
+
+
+
+void test_tog_batch()
+{
+    // match a bank of templates against shifted copies of a test image in a batch
+    // and check that the peaks for every frame are the same as matching one frame at a time
+    TOGMatcherBank bank;
+    TOGBatchMatcher batch;
+    Mat img;
+    std::vector<Mat> vframes;
+    std::vector<Mat> vtmatch;
+    std::vector<TOGMatcher::peak_info_t> vpeaks;
+    std::vector<std::vector<TOGMatcher::peak_info_t>> vvpeaks;
+
+    std::string simg = DATA_PATH;
+    simg += "bottle_100perc_b_on_w.png";
+    img = imread(simg, IMREAD_GRAYSCALE);
+
+    bank.init();
+    for (const auto& rinfo : vfiles)
+    {
+        std::string spath = DATA_PATH + rinfo.sname;
+        bank.add_template_from_file(spath.c_str(), rinfo.mag_thr);
+    }
+
+    for (int n = 0; n < 40; n++)
+    {
+        Mat frame;
+        Mat xform = (Mat_<double>(2, 3) << 1, 0, n % 7, 0, 1, n % 5);
+        warpAffine(img, frame, xform, img.size(), INTER_NEAREST, BORDER_REPLICATE);
+        vframes.push_back(frame);
+    }
+
+    batch.init(0, 8);
+    size_t nframes = batch.perform_match(bank, vframes, vvpeaks);
+
+    bool is_ok = (nframes == vframes.size());
+    for (size_t n = 0; is_ok && (n < vframes.size()); n++)
+    {
+        bank.perform_match(vframes[n], vtmatch, vpeaks);
+        for (size_t i = 0; i < vpeaks.size(); i++)
+        {
+            is_ok = is_ok && (vpeaks[i].pt == vvpeaks[n][i].pt) && (vpeaks[i].score == vvpeaks[n][i].score);
+        }
+    }
+    std::cout << "Batch frames=" << nframes << " ";
+    std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+}
+
+
+
+bool is_same_template(const TOGMatcher& ra, const TOGMatcher& rb)
+{
+    // templates and all their pyramid levels must have identical data
+    auto is_same_mat = [](const Mat& r0, const Mat& r1)
+    {
+        return (r0.size() == r1.size()) && (r0.type() == r1.type()) && (r0.empty() || (norm(r0, r1, NORM_INF) == 0.0));
+    };
+    bool result =
+        is_same_mat(ra.get_template_dx(), rb.get_template_dx()) &&
+        is_same_mat(ra.get_template_dy(), rb.get_template_dy()) &&
+        is_same_mat(ra.get_template_mask(), rb.get_template_mask()) &&
+        (ra.get_contours() == rb.get_contours()) &&
+        (ra.get_template_offset() == rb.get_template_offset()) &&
+        (ra.get_pyramid().size() == rb.get_pyramid().size());
+    for (size_t i = 0; result && (i < ra.get_pyramid().size()); i++)
+    {
+        result = is_same_template(ra.get_pyramid()[i], rb.get_pyramid()[i]);
+    }
+    return result;
+}
+
+
+
+void test_tog_library()
+{
+    // save a library then load it and check that every template from the library
+    // is the same as a template made from its image file (including pyramid levels)
+    // then check that only changed templates are compiled again
+    TOGLibrary lib;
+    TOGLibrary lib_loaded;
+    Mat img;
+    std::string slib = std::string(DATA_PATH) + "test_templates.togl";
+
+    std::string simg = DATA_PATH;
+    simg += "bottle_100perc_b_on_w.png";
+    img = imread(simg, IMREAD_GRAYSCALE);
+
+    for (const auto& rinfo : vfiles)
+    {
+        std::string spath = DATA_PATH + rinfo.sname;
+        for (const auto& k : vlibksize)
+        {
+            lib.add_template_from_file(rinfo.sname, spath, k, rinfo.mag_thr);
+        }
+    }
+
+    bool is_ok = lib.save(slib) && lib_loaded.load(slib) && (lib_loaded.size() == lib.size());
+    std::cout << "Library save and load templates=" << lib_loaded.size() << " ";
+    std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+
+    for (const auto& rinfo : vfiles)
+    {
+        std::string spath = DATA_PATH + rinfo.sname;
+        for (const auto& k : vlibksize)
+        {
+            TOGMatcher togm_file;
+            TOGMatcher togm_lib;
+            Mat tmatch_file;
+            Mat tmatch_lib;
+            togm_file.create_template_from_file(spath.c_str(), k, rinfo.mag_thr);
+            is_ok =
+                lib_loaded.get_template(rinfo.sname, k, rinfo.mag_thr, togm_lib) &&
+                is_same_template(togm_file, togm_lib);
+            if (is_ok)
+            {
+                togm_file.perform_match_pyramid(img, tmatch_file, true, k);
+                togm_lib.perform_match_pyramid(img, tmatch_lib, true, k);
+                is_ok = (norm(tmatch_file, tmatch_lib, NORM_INF) == 0.0);
+            }
+            std::cout << rinfo.sname << " K=" << k << " pyr=" << togm_lib.get_pyramid().size() << " ";
+            std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+        }
+    }
+
+    // library is still mapped from its file so it can't be saved over it
+    // nothing is compiled if files and thresholds are unchanged
+    // but a changed threshold compiles the template again (and releases the mapped file)
+    {
+        const T_file_info& rinfo = vfiles[0];
+        std::string spath = DATA_PATH + rinfo.sname;
+        size_t ncompiled = 0U;
+        is_ok = !lib_loaded.save(slib);
+        for (const auto& k : vlibksize)
+        {
+            ncompiled += (lib_loaded.update_template_from_file(rinfo.sname, spath, k, rinfo.mag_thr)) ? 1U : 0U;
+        }
+        is_ok = is_ok && (ncompiled == 0U);
+        is_ok = is_ok && lib_loaded.update_template_from_file(rinfo.sname, spath, vlibksize[0], rinfo.mag_thr + 0.1);
+        is_ok = is_ok && lib_loaded.save(slib) && lib_loaded.load(slib) && (lib_loaded.size() == lib.size());
+        is_ok = is_ok && !lib_loaded.update_template_from_file(rinfo.sname, spath, vlibksize[0], rinfo.mag_thr + 0.1);
+        std::cout << "Library update ";
+        std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+    }
+
+    lib_loaded.clear();
+    std::remove(slib.c_str());
+}
+
+
+
+bool is_same_landmarks(
+    const std::vector<cpoz::BGRLandmark::landmark_info_t>& ra,
+    const std::vector<cpoz::BGRLandmark::landmark_info_t>& rb,
+    const double rmatch_tol)
+{
+    bool result = (ra.size() == rb.size());
+    for (size_t i = 0; result && (i < ra.size()); i++)
+    {
+        result =
+            (ra[i].ctr == rb[i].ctr) &&
+            (ra[i].corr == rb[i].corr) &&
+            (ra[i].rng == rb[i].rng) &&
+            (ra[i].min == rb[i].min) &&
+            (ra[i].code == rb[i].code) &&
+            (std::fabs(ra[i].rmatch - rb[i].rmatch) <= rmatch_tol);
+    }
+    return result;
+}
+
+
+
+void test_bgrlm_batch_verify()
+{
+    // find landmarks in a noisy calibration image at several sizes
+    // and check that batch verification gives same landmarks as checking one at a time
+    cpoz::BGRLandmark bgrm;
+    Mat img_cal;
+    cpoz::BGRLandmark::create_multi_landmark_image(
+        img_cal, cpoz::BGRLandmark::CALIB_LABELS, 4, 3, 0.5, 2.25, 0.25, { 192,192,192 });
+
+    RNG rng(0);
+    for (const double scale : { 0.10, 0.12, 0.15 })
+    {
+        Mat img_bgr;
+        Mat img_gray;
+        Mat noise(img_cal.size(), CV_8SC3);
+        Mat tmatch;
+        std::vector<cpoz::BGRLandmark::landmark_info_t> vinfo_batch;
+        std::vector<cpoz::BGRLandmark::landmark_info_t> vinfo_single;
+
+        rng.fill(noise, RNG::NORMAL, 0, 8);
+        add(img_cal, noise, img_bgr, noArray(), CV_8UC3);
+        resize(img_bgr, img_bgr, {}, scale, scale, INTER_AREA);
+        cvtColor(img_bgr, img_gray, COLOR_BGR2GRAY);
+
+        bgrm.init(9, 0.6);
+        bgrm.perform_match(img_bgr, img_gray, tmatch, vinfo_batch);
+        bgrm.set_batch_verify_enable(false);
+        bgrm.perform_match(img_bgr, img_gray, tmatch, vinfo_single);
+
+        bool is_ok = is_same_landmarks(vinfo_batch, vinfo_single, 1.0e-5);
+        std::cout << "Scale=" << scale << " landmarks=" << vinfo_batch.size() << "," << vinfo_single.size() << " ";
+        std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+    }
+}
+
+
+
+void test_bgrlm_box_corr()
+{
+    // correlate noisy calibration image with every template size
+    // and check that box correlation is same as generic matchTemplate correlation
+    cpoz::BGRLandmark bgrm;
+    Mat img_cal;
+    Mat img_bgr;
+    Mat img_gray;
+    Mat noise;
+    cpoz::BGRLandmark::create_multi_landmark_image(
+        img_cal, cpoz::BGRLandmark::CALIB_LABELS, 4, 3, 0.5, 2.25, 0.25, { 192,192,192 });
+    noise = Mat(img_cal.size(), CV_8SC3);
+    RNG(0).fill(noise, RNG::NORMAL, 0, 8);
+    add(img_cal, noise, img_bgr, noArray(), CV_8UC3);
+    resize(img_bgr, img_bgr, {}, 0.12, 0.12, INTER_AREA);
+    cvtColor(img_bgr, img_gray, COLOR_BGR2GRAY);
+
+    for (int k = 7; k <= 15; k += 2)
+    {
+        Mat tmatch_box;
+        Mat tmatch_gen;
+        double qdiff;
+        std::vector<cpoz::BGRLandmark::landmark_info_t> vinfo_box;
+        std::vector<cpoz::BGRLandmark::landmark_info_t> vinfo_gen;
+
+        bgrm.init(k, 0.6);
+        bgrm.perform_match(img_bgr, img_gray, tmatch_box, vinfo_box);
+        bgrm.set_box_corr_enable(false);
+        bgrm.perform_match(img_bgr, img_gray, tmatch_gen, vinfo_gen);
+
+        qdiff = cv::norm(tmatch_box, tmatch_gen, NORM_INF);
+        bool is_ok = (qdiff < 1.0e-4) && is_same_landmarks(vinfo_box, vinfo_gen, 1.0e-5);
+        std::cout << "K=" << k << " diff=" << qdiff << " landmarks=" << vinfo_box.size() << "," << vinfo_gen.size() << " ";
+        std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+    }
+}
+
+
+
+void test_bgrlm_candidates()
+{
+    // find candidates in match results of noisy calibration image with every template size
+    // and check that they are same as the abs, dilate, compare, threshold, findNonZero calls they replaced
+    // match results are also quantized (plateaus) and have large values put on their borders
+    cpoz::BGRLandmark bgrm;
+    Mat img_cal;
+    Mat img_bgr;
+    Mat img_gray;
+    Mat noise;
+    cpoz::BGRLandmark::create_multi_landmark_image(
+        img_cal, cpoz::BGRLandmark::CALIB_LABELS, 4, 3, 0.5, 2.25, 0.25, { 192,192,192 });
+    noise = Mat(img_cal.size(), CV_8SC3);
+    RNG(0).fill(noise, RNG::NORMAL, 0, 8);
+    add(img_cal, noise, img_bgr, noArray(), CV_8UC3);
+    resize(img_bgr, img_bgr, {}, 0.12, 0.12, INTER_AREA);
+    cvtColor(img_bgr, img_gray, COLOR_BGR2GRAY);
+
+    const double thr_corr = 0.6;
+    for (int k = 7; k <= 15; k += 2)
+    {
+        Mat tmatch_raw;
+        Mat tmatch_quant;
+        Mat tmatch_border;
+
+        bgrm.init(k, thr_corr);
+        matchTemplate(img_gray, bgrm.get_template_p(), tmatch_raw, TM_CCOEFF_NORMED);
+
+        // plateaus
+        tmatch_raw.convertTo(tmatch_quant, CV_32S, 8.0);
+        tmatch_quant.convertTo(tmatch_quant, CV_32F, 1.0 / 8.0);
+
+        // peaks and plateaus of both signs on the border
+        tmatch_border = tmatch_raw.clone();
+        tmatch_border.row(0).colRange(0, tmatch_border.cols / 2).setTo(0.9);
+        tmatch_border.row(tmatch_border.rows - 1).setTo(-0.7);
+        tmatch_border.col(tmatch_border.cols - 1).rowRange(1, tmatch_border.rows / 2).setTo(-0.95);
+        tmatch_border.at<float>(tmatch_border.rows / 2, 0) = 0.99f;
+        tmatch_border.at<float>(0, tmatch_border.cols - 1) = 1.0f;
+
+        for (const auto& rtmatch_signed : { tmatch_raw, tmatch_quant, tmatch_border })
+        {
+            Mat tmatch_abs;
+            std::vector<cpoz::BGRLandmark::candidate_t> vcand;
+            bgrm.find_candidates(rtmatch_signed, tmatch_abs, vcand);
+
+            // old candidate search
+            Mat tmatch_ref = abs(rtmatch_signed);
+            Mat maxima_mask;
+            dilate(tmatch_ref, maxima_mask, Mat());
+            compare(tmatch_ref, maxima_mask, maxima_mask, CMP_GE);
+            Mat match_masked = (tmatch_ref > thr_corr);
+            maxima_mask = maxima_mask & match_masked;
+            std::vector<Point> vpts;
+            findNonZero(maxima_mask, vpts);
+
+            bool is_ok = (cv::norm(tmatch_abs, tmatch_ref, NORM_INF) == 0.0) && (vcand.size() == vpts.size());
+            for (size_t i = 0; is_ok && (i < vpts.size()); i++)
+            {
+                is_ok = (vcand[i].pt == vpts[i]) && (vcand[i].corr == rtmatch_signed.at<float>(vpts[i]));
+            }
+            std::cout << "K=" << k << " candidates=" << vcand.size() << "," << vpts.size() << " ";
+            std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+        }
+    }
+}
+
+
+
+void test_bgrlm_nv12()
+{
+    // find landmarks in a calibration image that has been converted to NV12
+    // and check that NV12 input gives same landmarks as matching the frame converted back to BGR
+    cpoz::BGRLandmark bgrm;
+    Mat img_cal;
+    Mat img_bgr;
+    Mat img_i420;
+    Mat noise;
+    cpoz::BGRLandmark::create_multi_landmark_image(
+        img_cal, cpoz::BGRLandmark::CALIB_LABELS, 4, 3, 0.5, 2.25, 0.25, { 192,192,192 });
+    noise = Mat(img_cal.size(), CV_8SC3);
+    RNG(0).fill(noise, RNG::NORMAL, 0, 8);
+    add(img_cal, noise, img_bgr, noArray(), CV_8UC3);
+    resize(img_bgr, img_bgr, {}, 0.12, 0.12, INTER_AREA);
+
+    // NV12 needs even dimensions
+    // and its UV rows are the I420 U and V planes interleaved
+    img_bgr = img_bgr(Rect(0, 0, img_bgr.cols & ~1, img_bgr.rows & ~1)).clone();
+    const int w = img_bgr.cols;
+    const int h = img_bgr.rows;
+    cvtColor(img_bgr, img_i420, COLOR_BGR2YUV_I420);
+    Mat img_nv12(img_i420.size(), CV_8UC1);
+    img_i420.rowRange(0, h).copyTo(img_nv12.rowRange(0, h));
+    Mat img_u(h / 2, w / 2, CV_8UC1, img_i420.ptr(h));
+    Mat img_v(h / 2, w / 2, CV_8UC1, img_i420.ptr(h) + (h / 2) * (w / 2));
+    Mat img_uv(h / 2, w / 2, CV_8UC2, img_nv12.ptr(h));
+    merge(std::vector<Mat>{ img_u, img_v }, img_uv);
+
+    Mat img_nv12_bgr;
+    cvtColor(img_nv12, img_nv12_bgr, COLOR_YUV2BGR_NV12);
+    Mat img_y = img_nv12.rowRange(0, h);
+
+    for (const bool is_batch : { true, false })
+    {
+        Mat tmatch_nv12;
+        Mat tmatch_ref;
+        std::vector<cpoz::BGRLandmark::landmark_info_t> vinfo_nv12;
+        std::vector<cpoz::BGRLandmark::landmark_info_t> vinfo_ref;
+
+        bgrm.init(9, 0.6);
+        bgrm.set_batch_verify_enable(is_batch);
+        bgrm.perform_match(img_nv12, tmatch_nv12, vinfo_nv12);
+        bgrm.perform_match(img_nv12_bgr, img_y, tmatch_ref, vinfo_ref);
+
+        bool is_ok = (cv::norm(tmatch_nv12, tmatch_ref, NORM_INF) == 0.0) && is_same_landmarks(vinfo_nv12, vinfo_ref, 0.0);
+        std::cout << "Batch=" << is_batch << " landmarks=" << vinfo_nv12.size() << "," << vinfo_ref.size() << " ";
+        std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+    }
+}
+
+
+
+void test_bgrlm_prefilter()
+{
+    // put a small noisy calibration image on a big blank wall
+    // and check that prefilter gives same landmarks as correlating the whole frame
+    cpoz::BGRLandmark bgrm;
+    Mat img_cal;
+    Mat img_bgr;
+    Mat img_gray;
+    Mat noise;
+    cpoz::BGRLandmark::create_multi_landmark_image(
+        img_cal, cpoz::BGRLandmark::CALIB_LABELS, 4, 3, 0.5, 2.25, 0.25, { 192,192,192 });
+    resize(img_cal, img_cal, {}, 0.12, 0.12, INTER_AREA);
+    img_bgr = Mat(img_cal.rows * 3, img_cal.cols * 3, CV_8UC3, { 160,160,160 });
+    img_cal.copyTo(img_bgr(Rect(img_cal.cols, img_cal.rows / 2, img_cal.cols, img_cal.rows)));
+    noise = Mat(img_bgr.size(), CV_8SC3);
+    RNG(0).fill(noise, RNG::NORMAL, 0, 4);
+    add(img_bgr, noise, img_bgr, noArray(), CV_8UC3);
+    cvtColor(img_bgr, img_gray, COLOR_BGR2GRAY);
+
+    for (int k = 7; k <= 15; k += 4)
+    {
+        Mat tmatch_pre;
+        Mat tmatch_all;
+        std::vector<cpoz::BGRLandmark::landmark_info_t> vinfo_pre;
+        std::vector<cpoz::BGRLandmark::landmark_info_t> vinfo_all;
+
+        bgrm.init(k, 0.6);
+        bgrm.perform_match(img_bgr, img_gray, tmatch_all, vinfo_all);
+        bgrm.set_prefilter_enable(true);
+        bgrm.perform_match(img_bgr, img_gray, tmatch_pre, vinfo_pre);
+
+        // fraction of match result that was skipped (set to 0 by prefilter)
+        const double skip = 1.0 - (countNonZero(tmatch_pre) / static_cast<double>(tmatch_pre.total()));
+        bool is_ok = is_same_landmarks(vinfo_pre, vinfo_all, 0.0);
+        std::cout << "K=" << k << " skipped=" << skip << " landmarks=" << vinfo_pre.size() << "," << vinfo_all.size() << " ";
+        std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+    }
+}
+
+
+
+void test_bgrlm_scales()
+{
+    // find landmarks in a noisy calibration image at sizes from 1x to 4x the template size
+    // and check that scale-space search finds them all with about the right scale
+    cpoz::BGRLandmark bgrm;
+    Mat img_cal;
+    cpoz::BGRLandmark::create_multi_landmark_image(
+        img_cal, cpoz::BGRLandmark::CALIB_LABELS, 4, 3, 0.5, 2.25, 0.25, { 192,192,192 });
+
+    RNG rng(0);
+    size_t nbase = 0;
+    double qbase = 0.0;
+    for (const double f : { 1.0, 1.5, 2.0, 3.0, 4.0 })
+    {
+        Mat img_bgr;
+        Mat img_gray;
+        Mat tmatch;
+        std::vector<cpoz::BGRLandmark::landmark_scale_info_t> vinfo;
+
+        resize(img_cal, img_bgr, {}, 0.12 * f, 0.12 * f, INTER_AREA);
+        Mat noise(img_bgr.size(), CV_8SC3);
+        rng.fill(noise, RNG::NORMAL, 0, 8);
+        add(img_bgr, noise, img_bgr, noArray(), CV_8UC3);
+        cvtColor(img_bgr, img_gray, COLOR_BGR2GRAY);
+
+        bgrm.init(9, 0.6);
+        bgrm.perform_match_scales(img_bgr, img_gray, tmatch, vinfo);
+
+        // average estimated scale should grow with size of landmarks in image
+        double qscale = 0.0;
+        for (const auto& r : vinfo)
+        {
+            qscale += r.scale;
+        }
+        qscale = (vinfo.size()) ? (qscale / vinfo.size()) : 0.0;
+        if (f == 1.0)
+        {
+            nbase = vinfo.size();
+            qbase = qscale;
+        }
+
+        const double qratio = (qbase > 0.0) ? (qscale / qbase) : 0.0;
+        bool is_ok = (vinfo.size() == nbase) && (qratio > f / 1.5) && (qratio < f * 1.5);
+        std::cout << "Size=" << f << " landmarks=" << vinfo.size() << " scale=" << qscale << " ";
+        std::cout << ((is_ok) ? "SUCCESS!" : "FAILURE!") << std::endl;
+    }
+}
+
+
+
 void dump_bgrlm_patterns()
 {
     // dump all patterns